@@ -1,4 +1,7 @@
 #include <appbase/application_base.hpp>
+#include <appbase/log.hpp>
+#include <appbase/memory_residency.hpp>
+#include <appbase/reclaimer.hpp>
 #include <appbase/version.hpp>
 
 #include <boost/algorithm/string.hpp>
@@ -10,6 +13,7 @@
 #include <unordered_map>
 #include <future>
 #include <optional>
+#include <set>
 
 #include <unistd.h>
 #include <signal.h>
@@ -80,6 +84,7 @@ class application_impl {
       std::string             _full_version_str = appbase_version_string;
 
       std::atomic_bool        _is_quiting{false};
+      bool                    _plugins_started{false}; ///< startup() has started all initialized plugins
 
       any_type_compare_map    _any_compare_map;
 
@@ -102,9 +107,23 @@ application_base::application_base(std::shared_ptr<void>&& e) :
    register_config_type<double>();
    register_config_type<std::vector<std::string>>();
    register_config_type<std::filesystem::path>();
+
+   // calibrated here rather than on the first timestamp taken on the main loop
+   fast_clock::calibrate();
+
+   cache_shrinker = memory_monitor.add_shrinker(std::numeric_limits<int>::max(), "caches",
+                                                [this](size_t target) { return cache_budget.shrink(target); });
 }
 
-application_base::~application_base() { }
+application_base::~application_base() {
+   profiler::instance().stop();
+   reclaimer::instance().stop();
+   if (const auto st = reclaimer::instance().get_stats(); st.deferred)
+      APPBASE_DLOG(get_logger("appbase"), "reclaimer: {} objects destroyed off thread in {} us (longest {} us), "
+                   "{} destroyed inline, peak backlog {}", st.reclaimed, st.reclaim_ns / 1000, st.max_reclaim_ns / 1000,
+                   st.inline_destroy, st.peak_backlog);
+   log_backend::instance().stop();
+}
 
 void application_base::set_version(uint64_t version) {
   my->_version = version;
@@ -170,10 +189,21 @@ void application_base::startup(boost::asio::io_context& io_ctx) {
    auto ss = setup_signal_handling_on_ioc(my->_signal_catching_io_ctx, true);
 
    try {
-      for( auto plugin : initialized_plugins ) {
+      make_memory_resident();
+      start_memory_pressure();
+      start_profiler();
+
+      // by index: lazy plugins activated while starting others are appended and started here too
+      for( size_t i = 0; i < initialized_plugins.size(); ++i ) {
          if( is_quiting() ) break;
-         plugin->startup();
+         initialized_plugins[i]->startup();
       }
+      my->_plugins_started = true;
+
+      // plugins whose plugin_startup() returned a sender complete startup concurrently on the main loop
+      run_until([&]() { return pending_startups == 0 || startup_error; }, false);
+      if( startup_error )
+         std::rethrow_exception( startup_error );
 
    } catch( ... ) {
       shutdown_plugins();
@@ -228,7 +258,48 @@ void application_base::set_program_options()
    options_description app_cfg_opts( "Application Config Options" );
    options_description app_cli_opts( "Application Command Line Options" );
    app_cfg_opts.add_options()
-         ("plugin", bpo::value< vector<string> >()->composing(), "Plugin(s) to enable, may be specified multiple times");
+         ("plugin", bpo::value< vector<string> >()->composing(), "Plugin(s) to enable, may be specified multiple times")
+         ("lazy-plugin", bpo::value< vector<string> >()->composing(),
+          "Plugin(s) to enable on the first use of a method or channel they declare, may be specified multiple times")
+         ("log-level", bpo::value<std::string>()->default_value("info"), "Minimum level of logged records: debug, info, warn, error or off")
+         ("log-level-for", bpo::value< vector<string> >()->composing(),
+          "Minimum level of the records of one logger, e.g. a plugin, as name=level; may be specified multiple times")
+         ("log-file", bpo::value<std::string>(), "File to log to instead of stderr, relative to data-dir")
+         ("log-rotate-size-mb", bpo::value<uint64_t>()->default_value(256), "Size in MiB after which the log file is rotated")
+         ("log-rotate-count", bpo::value<unsigned>()->default_value(8), "Number of rotated log files kept")
+         ("log-buffer-kb", bpo::value<unsigned>()->default_value(1024),
+          "Size in KiB of each thread's log buffer, records logged while it is full are dropped")
+         ("mlockall", bpo::bool_switch()->default_value(false), "Lock all current and future pages of the process in memory at startup")
+         ("hugepages", bpo::value<std::string>()->default_value("off"),
+          "Back appbase memory pools (handler slabs, log buffers) with 2MiB pages: off, transparent or explicit "
+          "(MAP_HUGETLB, falling back to transparent when no hugepages are reserved)")
+         ("prefault-stack-kb", bpo::value<unsigned>()->default_value(0),
+          "KiB of the main thread's and appbase::thread_pool threads' stacks to fault in at startup")
+         ("prefault-handler-slabs", bpo::value<unsigned>()->default_value(0),
+          "Slabs of handler storage per size class to allocate and fault in at startup")
+         ("cache-budget-mb", bpo::value<uint64_t>()->default_value(1024),
+          "MiB shared by all caches obtained with get_cache(), entries are evicted beyond it")
+         ("memory-pressure-interval-ms", bpo::value<unsigned>()->default_value(1000),
+          "Interval at which memory use is sampled to detect memory pressure, 0 to disable")
+         ("memory-pressure-rss-mb", bpo::value<uint64_t>()->default_value(0),
+          "Resident set size in MiB above which plugins are asked to release memory, 0 to ignore")
+         ("memory-pressure-cgroup-percent", bpo::value<double>()->default_value(0),
+          "Percentage of the cgroup's memory.max, used by other than inactive page cache, above which plugins are "
+          "asked to release memory, 0 to ignore")
+         ("memory-pressure-psi-avg10", bpo::value<double>()->default_value(0),
+          "Memory pressure stall 'some avg10' percentage above which plugins are asked to release memory, 0 to ignore")
+         ("memory-pressure-priority", bpo::value<int>()->default_value(priority::high),
+          "Priority at which plugins' shrinkers are run")
+         ("reclaim-backlog", bpo::value<unsigned>()->default_value(65536),
+          "Objects marked for deferred reclaim which may wait for destruction on the reclaimer thread, those retired "
+          "while it is full are destroyed by the caller; 0 disables the thread")
+         ("heap-accounting", bpo::bool_switch()->default_value(false),
+          "Attribute heap allocations to the plugins making them, see heap_usage(); requires the executable to link "
+          "appbase_heap_accounting")
+         ("profile-hz", bpo::value<unsigned>()->default_value(0),
+          "Samples per second of CPU time of the main thread's stack taken by the profiler, 0 to disable")
+         ("profile-file", bpo::value<std::string>(),
+          "File, relative to data-dir, to which the profile is written as folded stacks at exit");
 
    app_cli_opts.add_options()
          ("help,h", "Print this help message and exit.")
@@ -308,7 +379,7 @@ bool application_base::initialize_impl(int argc, char** argv, vector<abstract_pl
    my->_logging_conf = logconf;
    if(workaround != "logging.json" && !std::filesystem::exists(my->_logging_conf)) {
       // when logconf is explicitly specified, we must ensure the file exists
-      std::cerr << "Logging configuration file " << my->_logging_conf << " missing." << std::endl;
+      APPBASE_ELOG(get_logger("appbase"), "Logging configuration file {} missing.", my->_logging_conf);
       return false;
    }
 
@@ -320,7 +391,7 @@ bool application_base::initialize_impl(int argc, char** argv, vector<abstract_pl
    if(!std::filesystem::exists(my->_config_file_name)) {
       if(my->_config_file_name.compare(my->_config_dir / "config.ini") != 0)
       {
-         std::cerr << "Config file " << my->_config_file_name << " missing." << std::endl;
+         APPBASE_ELOG(get_logger("appbase"), "Config file {} missing.", my->_config_file_name);
          return false;
       }
       write_default_config(my->_config_file_name);
@@ -337,6 +408,12 @@ bool application_base::initialize_impl(int argc, char** argv, vector<abstract_pl
       BOOST_THROW_EXCEPTION(std::runtime_error("Unknown option '" + e.get_option_name() + "' inside the config file " +  full_config_file_path().string()));
    }
 
+   configure_memory_residency();
+   start_logging();
+   start_reclaimer();
+   cache_budget.set_limit(my->_options.at("cache-budget-mb").as<uint64_t>() << 20);
+   start_heap_accounting();
+
    std::vector<string> set_but_default_list;
 
    for(const boost::shared_ptr<bpo::option_description>& od_ptr : my->_cfg_options.options()) {
@@ -345,8 +422,8 @@ bool application_base::initialize_impl(int argc, char** argv, vector<abstract_pl
          continue;
 
       if(my->_any_compare_map.find(default_val.type()) == my->_any_compare_map.end()) {
-         std::cerr << "APPBASE: Developer -- the type " << default_val.type().name() << " is not registered with appbase," << std::endl;
-         std::cerr << "         add a register_config_type<>() in your plugin's ctor" << std::endl;
+         APPBASE_ELOG(get_logger("appbase"), "Developer -- the type {} is not registered with appbase, "
+                                             "add a register_config_type<>() in your plugin's ctor", default_val.type().name());
          return false;
       }
 
@@ -361,22 +438,15 @@ bool application_base::initialize_impl(int argc, char** argv, vector<abstract_pl
       }
    }
    if(set_but_default_list.size()) {
-      std::cerr << "APPBASE: Warning: The following configuration items in the config.ini file are redundantly set to" << std::endl;
-      std::cerr << "         their default value:" << std::endl;
-      std::cerr << "             ";
-      size_t chars_on_line = 0;
+      std::string items;
       for(auto it = set_but_default_list.cbegin(); it != set_but_default_list.end(); ++it) {
-         std::cerr << *it;
+         items += *it;
          if(it + 1 != set_but_default_list.end())
-            std::cerr << ", ";
-         if((chars_on_line += it->size()) > 65) {
-            std::cerr << std::endl << "             ";
-            chars_on_line = 0;
-         }
+            items += ", ";
       }
-      std::cerr << std::endl;
-      std::cerr << "         Explicit values will override future changes to application defaults. Consider commenting out or" << std::endl;
-      std::cerr << "         removing these items." << std::endl;
+      APPBASE_WLOG(get_logger("appbase"), "The following configuration items in the config.ini file are redundantly set to "
+                                          "their default value: {}. Explicit values will override future changes to application "
+                                          "defaults. Consider commenting out or removing these items.", items);
    }
 
    // Initialize user provided logging now so it is available during plugins' initialization
@@ -384,9 +454,39 @@ bool application_base::initialize_impl(int argc, char** argv, vector<abstract_pl
       initialize_logging();
 
    std::string plugin_name;
-   auto error_header = [&]() { return std::string("appbase: exception thrown during plugin \"") + plugin_name + "\" initialization.\n"; };
+   auto error_header = [&]() { return std::string("exception thrown during plugin \"") + plugin_name + "\" initialization"; };
 
    try {
+      // lazy plugins are initialized by activate_plugin() on first use, or earlier as a dependency of another plugin
+      std::set<abstract_plugin*> lazy_plugins;
+      if(options.count("lazy-plugin") > 0)
+      {
+         auto plugins = options.at("lazy-plugin").as<std::vector<std::string>>();
+         for(auto& arg : plugins)
+         {
+            vector<string> names;
+            boost::split(names, arg, boost::is_any_of(" \t,"));
+            for(const std::string& name : names) {
+               plugin_name = name;
+               auto& plug = get_plugin(name);
+               if(plug.register_activation())
+                  lazy_plugins.insert(&plug);
+               else
+                  APPBASE_WLOG(get_logger("appbase"), "plugin {} declares no APPBASE_PLUGIN_ACTIVATES_ON, enabling it at startup", name);
+            }
+         }
+         for(auto& arg : plugins)
+         {
+            vector<string> names;
+            boost::split(names, arg, boost::is_any_of(" \t,"));
+            for(const std::string& name : names) {
+               plugin_name = name;
+               if(!lazy_plugins.count(&get_plugin(name)))
+                  get_plugin(name).initialize(options);
+            }
+         }
+      }
+
       if(options.count("plugin") > 0)
       {
          auto plugins = options.at("plugin").as<std::vector<std::string>>();
@@ -396,44 +496,172 @@ bool application_base::initialize_impl(int argc, char** argv, vector<abstract_pl
             boost::split(names, arg, boost::is_any_of(" \t,"));
             for(const std::string& name : names) {
                plugin_name = name;
-               get_plugin(name).initialize(options);
+               if(!lazy_plugins.count(&get_plugin(name)))
+                  get_plugin(name).initialize(options);
             }
          }
       }
 
       for (auto plugin : autostart_plugins)
-         if (plugin != nullptr && plugin->get_state() == abstract_plugin::registered) {
+         if (plugin != nullptr && plugin->get_state() == abstract_plugin::registered && !lazy_plugins.count(plugin)) {
             plugin_name = plugin->name();
             plugin->initialize(options);
          }
 
       bpo::notify(options);
    } catch ( const boost::exception& e ) {
-      std::cerr << error_header() << boost::diagnostic_information(e) << "\n";
+      APPBASE_ELOG(get_logger("appbase"), "{}: {}", error_header(), boost::diagnostic_information(e));
       throw;
    } catch ( const std::exception& e ) {
-      std::cerr << error_header() << e.what() << "\n";
+      APPBASE_ELOG(get_logger("appbase"), "{}: {}", error_header(), e.what());
       throw;
    } catch (...) {
-      std::cerr << error_header();
+      APPBASE_ELOG(get_logger("appbase"), "{}", error_header());
       throw;
    }
 
    return true;
 }
 
+void application_base::configure_memory_residency() {
+   const auto& options = my->_options;
+   const auto  mode    = options.at("hugepages").as<std::string>();
+   auto        hp      = hugepage_mode_from_string(mode);
+   if (!hp)
+      BOOST_THROW_EXCEPTION(std::runtime_error("Invalid hugepages '" + mode + "', expected off, transparent or explicit"));
+   memory_residency::set_hugepages(*hp);
+   memory_residency::set_stack_prefault(size_t(options.at("prefault-stack-kb").as<unsigned>()) << 10);
+}
+
+void application_base::make_memory_resident() {
+   const auto& options = my->_options;
+   const bool  lock    = options.at("mlockall").as<bool>();
+   const auto  slabs   = options.at("prefault-handler-slabs").as<unsigned>();
+
+   std::string lock_error = lock ? memory_residency::lock_all() : std::string();
+   const size_t stack_bytes   = memory_residency::prefault_stack();
+   const size_t handler_bytes = slabs && prefault_handlers_cb ? prefault_handlers_cb(slabs) : 0;
+
+   const auto   stats      = memory_residency::get_stats();
+   const bool   configured = lock || slabs || stack_bytes || memory_residency::hugepages() != hugepage_mode::off;
+   // the level depends on the options, so the compile time filter of APPBASE_LOG does not apply
+   auto&       log   = get_logger("appbase");
+   const auto  level = configured ? log_level::info : log_level::debug;
+   if (log.enabled(level))
+      log.write(level, __FILE__, __LINE__,
+                "memory residency: mlockall {}, hugepages {}, pools {} KiB ({} KiB explicit hugepages, {} fallbacks), "
+                "prefaulted stack {} KiB, handler slabs {} KiB",
+                !lock ? "off" : lock_error.empty() ? "on" : "failed: " + lock_error,
+                to_string(memory_residency::hugepages()), stats.region_bytes >> 10, stats.hugetlb_bytes >> 10,
+                stats.fallbacks, stack_bytes >> 10, handler_bytes >> 10);
+}
+
+void application_base::start_logging() {
+   const auto& options = my->_options;
+   log_config  config;
+
+   auto parse_level = [](const std::string& name) {
+      auto level = log_level_from_string(name);
+      if (!level)
+         BOOST_THROW_EXCEPTION(std::runtime_error("Invalid log level '" + name + "'"));
+      return *level;
+   };
+   config.level = parse_level(options.at("log-level").as<std::string>());
+   if (options.count("log-level-for")) {
+      for (const auto& arg : options.at("log-level-for").as<vector<string>>()) {
+         auto eq = arg.find('=');
+         if (eq == string::npos)
+            BOOST_THROW_EXCEPTION(std::runtime_error("Invalid log-level-for '" + arg + "', expected name=level"));
+         config.levels[arg.substr(0, eq)] = parse_level(arg.substr(eq + 1));
+      }
+   }
+   if (options.count("log-file")) {
+      std::filesystem::path file = options.at("log-file").as<std::string>();
+      config.file = file.is_relative() ? my->_data_dir / file : file;
+   }
+   config.rotate_size  = options.at("log-rotate-size-mb").as<uint64_t>() << 20;
+   config.rotate_count = options.at("log-rotate-count").as<unsigned>();
+   config.buffer_size  = size_t(options.at("log-buffer-kb").as<unsigned>()) << 10;
+
+   log_backend::instance().start(std::move(config));
+}
+
+void application_base::start_memory_pressure() {
+   const auto&             options = my->_options;
+   memory_pressure::config cfg;
+   cfg.interval       = std::chrono::milliseconds(options.at("memory-pressure-interval-ms").as<unsigned>());
+   cfg.rss_limit      = options.at("memory-pressure-rss-mb").as<uint64_t>() << 20;
+   cfg.cgroup_percent = options.at("memory-pressure-cgroup-percent").as<double>();
+   cfg.psi_avg10      = options.at("memory-pressure-psi-avg10").as<double>();
+   cfg.priority       = options.at("memory-pressure-priority").as<int>();
+   memory_monitor.start(cfg);
+}
+
+void application_base::start_reclaimer() {
+   const auto backlog = my->_options.at("reclaim-backlog").as<unsigned>();
+   if (backlog)
+      reclaimer::instance().start(backlog);
+   else
+      reclaimer::instance().stop();
+}
+
+void application_base::start_heap_accounting() {
+   const bool on = my->_options.at("heap-accounting").as<bool>();
+   if (on && !heap_accounting::interposed()) {
+      APPBASE_WLOG(get_logger("appbase"), "heap-accounting requires linking appbase_heap_accounting, not enabled");
+      return;
+   }
+   heap_accounting::enable(on);
+}
+
+void application_base::start_profiler() {
+   profiler::config cfg;
+   cfg.hz = my->_options.at("profile-hz").as<unsigned>();
+   if (cfg.hz)
+      profiler::instance().start(cfg);
+}
+
+void application_base::stop_profiler() {
+   if (!profiler::instance().running())
+      return;
+   profiler::instance().stop();
+   if (my->_options.count("profile-file")) {
+      std::filesystem::path file = my->_options.at("profile-file").as<std::string>();
+      write_profile(file.is_relative() ? my->_data_dir / file : file);
+   }
+}
+
+bool application_base::write_profile(const std::filesystem::path& file) {
+   std::ofstream out(file, std::ios::trunc);
+   profiler::instance().write_folded(out, tag_name_cb);
+   if (!out.flush()) {
+      APPBASE_ELOG(get_logger("appbase"), "Unable to write profile to {}", file.string());
+      return false;
+   }
+   const auto st = profiler::instance().get_stats();
+   APPBASE_ILOG(get_logger("appbase"), "profile of {} samples ({} dropped) written to {}", st.samples, st.dropped,
+                file.string());
+   return true;
+}
+
 void application_base::handle_exception(std::exception_ptr eptr, std::string_view origin) {
    try {
       if (eptr)
          std::rethrow_exception(eptr);
    } catch(const std::exception& e) {
-      std::cerr << "Caught " << origin << " exception: \"" << e.what() << "\"\n";
+      APPBASE_ELOG(get_logger("appbase"), "Caught {} exception: \"{}\"", origin, e.what());
    } catch(...) {
-      std::cerr << "Caught unknown " << origin << " exception.\n";
+      APPBASE_ELOG(get_logger("appbase"), "Caught unknown {} exception.", origin);
    }
 }
 
 void application_base::shutdown_plugins() {
+   memory_monitor.stop();
+
+   // a plugin is not shut down while its asynchronous plugin_startup() runs, whose completion refers to it: wait
+   // for those still pending when startup failed or quit() was called during startup
+   run_until([&]() { return pending_startups == 0; }, true);
+
    std::exception_ptr eptr = nullptr;
 
    for(auto ritr = running_plugins.rbegin();
@@ -453,6 +681,83 @@ void application_base::shutdown_plugins() {
       std::rethrow_exception(eptr);
 }
 
+void application_base::activate_plugin(abstract_plugin& plug) {
+   if( plug.get_state() != abstract_plugin::registered || is_quiting() )
+      return;
+   plug.initialize(my->_options);
+   if( my->_plugins_started )
+      plug.startup();
+}
+
+void application_base::swap_plugin(std::unique_ptr<abstract_plugin>& replacement) {
+   const std::string name = replacement->name();
+   auto itr = plugins.find(name);
+   if( itr == plugins.end() )
+      BOOST_THROW_EXCEPTION(std::runtime_error("unable to replace plugin, not registered: " + name));
+   abstract_plugin* old = itr->second.get();
+   if( old->get_state() != abstract_plugin::started || replacement->get_state() != abstract_plugin::registered )
+      BOOST_THROW_EXCEPTION(std::runtime_error("unable to replace plugin, not running: " + name));
+
+   const size_t init_idx = std::find(initialized_plugins.begin(), initialized_plugins.end(), old) - initialized_plugins.begin();
+   const size_t run_idx  = std::find(running_plugins.begin(), running_plugins.end(), old) - running_plugins.begin();
+
+   // initializes and starts `p` in the old instance's position; on failure leaves the old instance in its place
+   // (shut down) and `p` shut down
+   auto bring_up = [&](abstract_plugin* p, std::any state) {
+      const size_t initialized = initialized_plugins.size();
+      const size_t running     = running_plugins.size();
+      try {
+         // `p` is appended by initialize() and startup(), move it to the old instance's position
+         p->initialize(my->_options);
+         initialized_plugins.resize(initialized);
+         initialized_plugins[init_idx] = p;
+
+         p->import_state(std::move(state));
+
+         p->startup();
+         running_plugins.resize(running);
+         running_plugins[run_idx] = p;
+      } catch(...) {
+         const bool started = running_plugins.size() > running;
+         initialized_plugins.resize(initialized);
+         running_plugins.resize(running);
+         initialized_plugins[init_idx] = old;
+         running_plugins[run_idx] = old;
+         if( started ) {
+            try {
+               p->shutdown();
+            } catch(...) {
+               handle_exception(std::current_exception(), p->name());
+            }
+         }
+         throw;
+      }
+   };
+
+   std::any state = old->export_state();
+   old->shutdown();
+
+   // the old instance stays owned (in `replacement` while the new one is registered) until the new one has started,
+   // so that initialized_plugins and running_plugins never refer to a destroyed plugin
+   abstract_plugin* repl = replacement.get();
+   itr->second.swap(replacement);
+
+   try {
+      bring_up(repl, state);
+   } catch(...) {
+      // bring the old instance back with the state it exported, the failed replacement is retired instead
+      std::exception_ptr error = std::current_exception();
+      itr->second.swap(replacement);
+      try {
+         old->reset_stopped();
+         bring_up(old, std::move(state));
+      } catch(...) {
+         handle_exception(std::current_exception(), name);
+      }
+      std::rethrow_exception(error);
+   }
+}
+
 void application_base::destroy_plugins() {
    std::exception_ptr eptr = nullptr;
 
@@ -498,13 +803,13 @@ void application_base::set_thread_priority_max() {
    int policy = 0;
    int ret = pthread_getschedparam(this_thread, &policy, &params);
    if( ret != 0 ) {
-      std::cerr << "ERROR: Unable to get thread priority" << std::endl;
+      APPBASE_ELOG(get_logger("appbase"), "Unable to get thread priority");
    }
 
    params.sched_priority = sched_get_priority_max(policy);
    ret = pthread_setschedparam(this_thread, policy, &params);
    if( ret != 0 ) {
-      std::cerr << "ERROR: Unable to set thread priority" << std::endl;
+      APPBASE_ELOG(get_logger("appbase"), "Unable to set thread priority");
    }
 #endif
 }
@@ -0,0 +1,74 @@
+#include <appbase/cache.hpp>
+
+namespace appbase {
+
+cache_base::cache_base(std::string name, cache_budget& budget) : budget_(budget), name_(std::move(name)) {
+   budget_.add(this);
+}
+
+cache_base::~cache_base() {
+   budget_.remove(this);
+}
+
+size_t cache_budget::fair_share() const {
+   std::lock_guard g(mtx_);
+   return limit() / std::max<size_t>(1, caches_.size());
+}
+
+size_t cache_budget::evict_for(const cache_base& requester, size_t bytes, const void* locked_shard) {
+   // no lock is held while evicting, the caller holds a shard lock and the shards of others are only tried
+   cache_base* largest = nullptr;
+   {
+      std::lock_guard g(mtx_);
+      const size_t    share = limit() / std::max<size_t>(1, caches_.size());
+      size_t          most  = share;
+      for (auto* c : caches_) {
+         if (c != &requester && c->bytes() > most) {
+            largest = c;
+            most    = c->bytes();
+         }
+      }
+   }
+   return largest ? largest->evict(bytes, locked_shard) : 0;
+}
+
+size_t cache_budget::shrink(size_t bytes) {
+   std::vector<cache_base*> caches;
+   {
+      std::lock_guard g(mtx_);
+      caches = caches_;
+   }
+   std::sort(caches.begin(), caches.end(), [](auto* a, auto* b) { return a->bytes() > b->bytes(); });
+   size_t freed = 0;
+   for (auto* c : caches) {
+      if (freed >= bytes)
+         break;
+      freed += c->evict(bytes - freed, nullptr);
+   }
+   return freed;
+}
+
+std::vector<std::pair<std::string, cache_stats>> cache_budget::stats() const {
+   std::vector<cache_base*> caches;
+   {
+      std::lock_guard g(mtx_);
+      caches = caches_;
+   }
+   std::vector<std::pair<std::string, cache_stats>> result;
+   result.reserve(caches.size());
+   for (auto* c : caches)
+      result.emplace_back(c->name(), c->stats());
+   return result;
+}
+
+void cache_budget::add(cache_base* c) {
+   std::lock_guard g(mtx_);
+   caches_.push_back(c);
+}
+
+void cache_budget::remove(cache_base* c) {
+   std::lock_guard g(mtx_);
+   caches_.erase(std::remove(caches_.begin(), caches_.end(), c), caches_.end());
+}
+
+} // namespace appbase
@@ -0,0 +1,129 @@
+#include <appbase/heap_accounting.hpp>
+
+#include <cstdlib>
+#include <new>
+
+namespace appbase {
+
+namespace {
+   /**
+    * Counters of the thread which owns the block. Only the owner writes them, with a relaxed load and store, while
+    * snapshots read them from other threads. Blocks are never freed: a thread exiting releases its block to the next
+    * thread which allocates, the counters being totals per tag rather than per thread.
+    */
+   struct counters_block {
+      struct counters {
+         std::atomic<int64_t>  live_bytes{0};
+         std::atomic<uint64_t> allocations{0};
+         std::atomic<uint64_t> allocated_bytes{0};
+         std::atomic<uint64_t> frees{0};
+      };
+
+      counters                     tags[heap_accounting::max_tags];
+      std::atomic<bool>            in_use{true};
+      counters_block*              next = nullptr;
+   };
+
+   std::atomic<counters_block*> blocks{nullptr};
+
+   template <typename T, typename V>
+   void add(std::atomic<T>& counter, V n) {
+      counter.store(counter.load(std::memory_order_relaxed) + T(n), std::memory_order_relaxed);
+   }
+
+   // allocated with calloc rather than operator new, which is what is being counted
+   counters_block* acquire_block() noexcept {
+      for (auto* b = blocks.load(std::memory_order_acquire); b; b = b->next) {
+         bool free = false;
+         if (!b->in_use.load(std::memory_order_relaxed) && b->in_use.compare_exchange_strong(free, true))
+            return b;
+      }
+      void* mem = std::calloc(1, sizeof(counters_block));
+      if (!mem)
+         return nullptr;
+      auto* b = ::new (mem) counters_block;
+      b->next = blocks.load(std::memory_order_relaxed);
+      while (!blocks.compare_exchange_weak(b->next, b, std::memory_order_release, std::memory_order_relaxed))
+         ;
+      return b;
+   }
+
+   thread_local counters_block* local = nullptr;
+
+   struct block_release {
+      ~block_release() {
+         if (local) {
+            local->in_use.store(false, std::memory_order_release);
+            local = nullptr;
+         }
+      }
+   };
+
+   counters_block* local_block() noexcept {
+      if (!local) {
+         // its destructor is registered on first use, through __cxa_thread_atexit which does not use operator new
+         thread_local block_release release;
+         (void)release;
+         local = acquire_block();
+      }
+      return local;
+   }
+} // namespace
+
+uint32_t heap_accounting::on_alloc(size_t size) noexcept {
+   if (!enabled())
+      return untracked;
+   auto* b = local_block();
+   if (!b)
+      return untracked;
+   uint32_t tag = execution_priority_queue::current_tag();
+   if (tag >= max_tags)
+      tag = execution_priority_queue::default_tag;
+   auto& c = b->tags[tag];
+   add(c.live_bytes, size);
+   add(c.allocations, 1);
+   add(c.allocated_bytes, size);
+   return tag;
+}
+
+void heap_accounting::on_free(uint32_t tag, size_t size) noexcept {
+   if (tag >= max_tags)
+      return;
+   auto* b = local_block();
+   if (!b)
+      return;
+   auto& c = b->tags[tag];
+   add(c.live_bytes, -int64_t(size));
+   add(c.frees, 1);
+}
+
+std::vector<heap_accounting::usage> heap_accounting::snapshot() {
+   std::vector<usage> result(max_tags);
+   for (auto* b = blocks.load(std::memory_order_acquire); b; b = b->next) {
+      for (size_t tag = 0; tag < max_tags; ++tag) {
+         const auto& c = b->tags[tag];
+         auto&       u = result[tag];
+         u.live_bytes += c.live_bytes.load(std::memory_order_relaxed);
+         u.allocations += c.allocations.load(std::memory_order_relaxed);
+         u.allocated_bytes += c.allocated_bytes.load(std::memory_order_relaxed);
+         u.frees += c.frees.load(std::memory_order_relaxed);
+      }
+   }
+   return result;
+}
+
+heap_accounting::usage heap_accounting::get(execution_priority_queue::queue_tag tag) {
+   usage u;
+   if (tag >= max_tags)
+      return u;
+   for (auto* b = blocks.load(std::memory_order_acquire); b; b = b->next) {
+      const auto& c = b->tags[tag];
+      u.live_bytes += c.live_bytes.load(std::memory_order_relaxed);
+      u.allocations += c.allocations.load(std::memory_order_relaxed);
+      u.allocated_bytes += c.allocated_bytes.load(std::memory_order_relaxed);
+      u.frees += c.frees.load(std::memory_order_relaxed);
+   }
+   return u;
+}
+
+} // namespace appbase
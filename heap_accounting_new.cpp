@@ -0,0 +1,98 @@
+// Replacement global operator new/delete counting allocations with appbase::heap_accounting, built as the
+// appbase_heap_accounting library which an executable links to enable the `heap-accounting` option.
+
+#include <appbase/heap_accounting.hpp>
+
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+namespace {
+   using appbase::heap_accounting;
+
+   /// stored in front of every allocation so that the matching delete knows what to uncount
+   struct header {
+      uint32_t tag;
+      uint32_t offset; ///< from the start of the block obtained from malloc to the allocation
+      uint64_t size;
+   };
+   static_assert(sizeof(header) == 16);
+
+   constexpr size_t default_alignment = __STDCPP_DEFAULT_NEW_ALIGNMENT__ < sizeof(header) ? sizeof(header)
+                                                                                         : __STDCPP_DEFAULT_NEW_ALIGNMENT__;
+
+   [[maybe_unused]] const bool registered = (heap_accounting::set_interposed(), true);
+
+   void* try_allocate(size_t size, size_t alignment) noexcept {
+      const size_t offset = alignment;
+      if (size > SIZE_MAX - offset)
+         return nullptr;
+      void* block = nullptr;
+      if (alignment <= __STDCPP_DEFAULT_NEW_ALIGNMENT__)
+         block = std::malloc(size + offset);
+      else if (::posix_memalign(&block, alignment, size + offset) != 0)
+         block = nullptr;
+      if (!block)
+         return nullptr;
+      char* p = static_cast<char*>(block) + offset;
+      ::new (p - sizeof(header)) header{heap_accounting::on_alloc(size), uint32_t(offset), size};
+      return p;
+   }
+
+   void* allocate(size_t size, size_t alignment) {
+      while (true) {
+         if (void* p = try_allocate(size, alignment))
+            return p;
+         std::new_handler handler = std::get_new_handler();
+         if (!handler)
+            throw std::bad_alloc();
+         handler();
+      }
+   }
+
+   void* allocate_nothrow(size_t size, size_t alignment) noexcept {
+      try {
+         return allocate(size, alignment);
+      } catch (...) {
+         return nullptr;
+      }
+   }
+
+   void deallocate(void* p) noexcept {
+      if (!p)
+         return;
+      const auto* h = reinterpret_cast<const header*>(static_cast<char*>(p) - sizeof(header));
+      heap_accounting::on_free(h->tag, h->size);
+      std::free(static_cast<char*>(p) - h->offset);
+   }
+
+   size_t aligned(std::align_val_t alignment) {
+      return std::max(size_t(alignment), default_alignment);
+   }
+} // namespace
+
+void* operator new(size_t size) { return allocate(size, default_alignment); }
+void* operator new[](size_t size) { return allocate(size, default_alignment); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return allocate_nothrow(size, default_alignment); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return allocate_nothrow(size, default_alignment); }
+void* operator new(size_t size, std::align_val_t al) { return allocate(size, aligned(al)); }
+void* operator new[](size_t size, std::align_val_t al) { return allocate(size, aligned(al)); }
+void* operator new(size_t size, std::align_val_t al, const std::nothrow_t&) noexcept {
+   return allocate_nothrow(size, aligned(al));
+}
+void* operator new[](size_t size, std::align_val_t al, const std::nothrow_t&) noexcept {
+   return allocate_nothrow(size, aligned(al));
+}
+
+void operator delete(void* p) noexcept { deallocate(p); }
+void operator delete[](void* p) noexcept { deallocate(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { deallocate(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { deallocate(p); }
+void operator delete(void* p, size_t) noexcept { deallocate(p); }
+void operator delete[](void* p, size_t) noexcept { deallocate(p); }
+void operator delete(void* p, std::align_val_t) noexcept { deallocate(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { deallocate(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { deallocate(p); }
+void operator delete[](void* p, size_t, std::align_val_t) noexcept { deallocate(p); }
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept { deallocate(p); }
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept { deallocate(p); }
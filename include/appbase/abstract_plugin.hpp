@@ -1,6 +1,7 @@
 #pragma once
 #include <boost/program_options.hpp>
 #include <boost/preprocessor/seq/for_each.hpp>
+#include <any>
 #include <string>
 #include <vector>
 #include <map>
@@ -13,6 +14,19 @@
       BOOST_PP_SEQ_FOR_EACH(APPBASE_PLUGIN_REQUIRES_VISIT, l, PLUGINS)                                                 \
    }
 
+#define APPBASE_PLUGIN_ACTIVATES_ON_VISIT(r, visitor, elem) visitor(static_cast<elem*>(nullptr));
+
+/**
+ * Declare the methods (method_decl) and channels (channel_decl) whose first use activates this plugin when it is
+ * configured with `lazy-plugin`: a call of a method, or a subscribe or publish on a channel.
+ * e.g. APPBASE_PLUGIN_ACTIVATES_ON((compute_method)(blocks_channel))
+ */
+#define APPBASE_PLUGIN_ACTIVATES_ON(DECLS)                                                                             \
+   template <typename Lambda>                                                                                          \
+   void plugin_activates_on(Lambda&& l) {                                                                              \
+      BOOST_PP_SEQ_FOR_EACH(APPBASE_PLUGIN_ACTIVATES_ON_VISIT, l, DECLS)                                               \
+   }
+
 namespace appbase {
 
 using boost::program_options::options_description;
@@ -38,6 +52,22 @@ public:
    virtual void handle_sighup() = 0;
    virtual void startup() = 0;
    virtual void shutdown() = 0;
+
+   /**
+    * Attach activation of this plugin to the methods and channels of its APPBASE_PLUGIN_ACTIVATES_ON
+    * @return false if the plugin declares none, in which case it cannot be activated lazily
+    */
+   virtual bool register_activation() = 0;
+
+   /// state handed from a running instance to its replacement, see application_t::replace_plugin()
+   ///@{
+   virtual std::any export_state() = 0;
+   virtual void import_state(std::any state) = 0;
+   ///@}
+
+   /// return a stopped plugin to registered so that it can be initialized and started again, see
+   /// application_t::replace_plugin()
+   virtual void reset_stopped() = 0;
 };
 
 } // namespace appbase
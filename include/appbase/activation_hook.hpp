@@ -0,0 +1,49 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace appbase {
+
+/**
+ * Callbacks run on the first use of a method or channel to activate plugins configured as `lazy-plugin` (see
+ * APPBASE_PLUGIN_ACTIVATES_ON). Callbacks are added on the main thread before the method or channel is used; it may
+ * then be used from any thread. Every caller arriving before activation has completed runs the callbacks, which
+ * must be idempotent and return once the plugins are active, so no caller proceeds before then. The cost once
+ * activated, or when no lazy plugin is attached, is an atomic load.
+ */
+class activation_hook {
+public:
+   void add(std::function<void()> f) {
+      _activators.push_back(std::move(f));
+      _pending.store(true, std::memory_order_release);
+   }
+
+   void operator()() {
+      if (__builtin_expect(_pending.load(std::memory_order_acquire), 0))
+         fire();
+   }
+
+private:
+   void fire() {
+      // a callback using the method or channel while activating (on the main thread) must not clear _pending
+      struct firing {
+         activation_hook& h;
+         firing(activation_hook& h) : h(h) { h._firing.fetch_add(1, std::memory_order_acq_rel); }
+         ~firing() {
+            if (h._firing.fetch_sub(1, std::memory_order_acq_rel) == 1)
+               h._pending.store(false, std::memory_order_release);
+         }
+      } guard(*this);
+      for (auto& f : _activators)
+         f();
+   }
+
+   std::vector<std::function<void()>> _activators; ///< only modified by add(), before concurrent use
+   std::atomic<bool>                  _pending{false};
+   std::atomic<uint32_t>              _firing{0};  ///< callers running the callbacks
+};
+
+} // namespace appbase
@@ -1,14 +1,26 @@
 #pragma once
 
 #include <appbase/abstract_plugin.hpp>
+#include <appbase/cache.hpp>
 #include <appbase/channel.hpp>
 #include <appbase/method.hpp>
+#include <appbase/execution_priority_queue.hpp>
+#include <appbase/heap_accounting.hpp>
+#include <appbase/log.hpp>
+#include <appbase/memory_pressure.hpp>
+#include <appbase/profiler.hpp>
 #include <boost/core/demangle.hpp>
 #include <boost/program_options/option.hpp>
 #include <typeindex>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <exception>
+#include <stdexcept>
 #include <string_view>
 #include <filesystem>
+#include <future>
+#include <thread>
 
 namespace appbase {
 namespace bpo = boost::program_options;
@@ -23,6 +35,19 @@ struct priority {
    static constexpr int medium_high = 75;
    static constexpr int high        = 100;
    static constexpr int highest     = std::numeric_limits<int>::max();
+
+   /**
+    * Priority of the handler currently executing on this thread, adjusted by `delta` (positive to boost,
+    * negative to decay) and saturated to [lowest, highest]. Allows async chains started by a handler to keep
+    * the priority of the work that started them.
+    *
+    * @param delta adjustment applied to the inherited priority
+    * @param fallback priority used when not called from within a handler executed by the priority queue
+    */
+   static int inherit(int delta = 0, int fallback = medium) {
+      int64_t p = int64_t{execution_priority_queue::current_priority(fallback)} + delta;
+      return static_cast<int>(std::clamp<int64_t>(p, lowest, highest));
+   }
 };
 
 class application_base {
@@ -122,6 +147,7 @@ public:
     */
    template <typename Executor>
    void exec(Executor& exec) {
+      main_thread.store(std::this_thread::get_id(), std::memory_order_relaxed);
       std::exception_ptr eptr = nullptr;
       {
          auto& io_ctx{exec.get_io_context()};
@@ -145,6 +171,8 @@ public:
          }
 
          quit();
+         // a plugin replacement still waiting for the plugin's handlers to drain is abandoned
+         exec.get_priority_queue().release_all();
 
          try {
             shutdown_plugins();   // may rethrow exceptions
@@ -152,6 +180,7 @@ public:
             if (!eptr)
                eptr = std::current_exception();
          }
+         stop_profiler();
 
          work.reset();
 
@@ -275,6 +304,37 @@ public:
       }
    }
 
+   /**
+    * Fetch the cache `name`, constructed on first access with `shards` shards, so that plugins using the same name
+    * share it. All caches are accounted against get_cache_budget().
+    *
+    * @throws std::logic_error if the cache was created with other types
+    */
+   template <typename Key, typename Value, typename Hash = std::hash<Key>>
+   sharded_cache<Key, Value, Hash>& get_cache(std::string_view name, size_t shards = 16) {
+      using cache_type = sharded_cache<Key, Value, Hash>;
+      auto itr = caches.find(name);
+      if (itr == caches.end())
+         itr = caches.emplace(std::string(name), std::make_unique<cache_type>(std::string(name), cache_budget, shards)).first;
+      auto* cache = dynamic_cast<cache_type*>(itr->second.get());
+      if (!cache)
+         throw std::logic_error("cache '" + std::string(name) + "' was created with different key or value types");
+      return *cache;
+   }
+
+   /**
+    * Monitor of the process's memory use, configured by the `memory-pressure-*` options, to which plugins add
+    * shrinkers. Caches are shrunk first.
+    */
+   appbase::memory_pressure& get_memory_pressure() {
+      return memory_monitor;
+   }
+
+   /// byte budget shared by the caches, limited by the `cache-budget-mb` option
+   appbase::cache_budget& get_cache_budget() {
+      return cache_budget;
+   }
+
    const bpo::variables_map& get_options() const;
    const std::vector<bpo::basic_option<char>>& get_parsed_options() const;
 
@@ -292,12 +352,49 @@ public:
       post_cb = std::move(cb);
    }
 
+   /**
+    * Set the function running one iteration of the main loop outside of exec(), used while waiting for
+    * asynchronous plugin startup and shutdown.
+    */
+   void set_run_one_cb(std::function<void()> cb) {
+      run_one_cb = std::move(cb);
+   }
+
+   /**
+    * Set the function adding slabs of handler storage to the executor, see `prefault-handler-slabs`.
+    * It returns the number of bytes added.
+    */
+   void set_prefault_handlers_cb(std::function<size_t(size_t)> cb) {
+      prefault_handlers_cb = std::move(cb);
+   }
+
+   /// Set the function naming queue tags (plugins) in profiles
+   void set_tag_name_cb(profiler::tag_name_fn cb) {
+      tag_name_cb = std::move(cb);
+   }
+
+   /**
+    * Write the samples taken by the profiler, started on the main thread by the `profile-hz` option, as folded
+    * stacks split by plugin and handler, e.g. for flamegraph.pl. Also written to `profile-file` at exit. Must be
+    * called from the main thread.
+    * @return false if the file could not be written
+    */
+   bool write_profile(const std::filesystem::path& file);
+
 
 protected:
    template <typename Impl>
    friend class plugin;
 
    bool initialize_impl(int argc, char** argv, vector<abstract_plugin*> autostart_plugins, std::function<void()> initialize_logging);
+   void start_logging(); ///< start the log_backend from the log-* options
+   void start_reclaimer(); ///< start the reclaimer from the reclaim-backlog option
+   void start_memory_pressure(); ///< start the memory_pressure monitor from the memory-pressure-* options
+   void start_heap_accounting(); ///< enable heap_accounting from the heap-accounting option
+   void start_profiler(); ///< start the profiler on the calling thread from the profile-hz option
+   void stop_profiler(); ///< stop the profiler and write it to profile-file
+   void configure_memory_residency(); ///< apply the hugepages and prefault-stack-kb options
+   void make_memory_resident(); ///< apply mlockall and prefaulting before plugins start, and report
 
    /** these notifications get called from the plugin when their state changes so that
     * the application can call shutdown in the reverse order.
@@ -314,6 +411,70 @@ protected:
    void shutdown_plugins();
    void destroy_plugins();
 
+   /**
+    * Initialize (and start, if the application has been started) a plugin configured as `lazy-plugin` on the
+    * first use of one of its APPBASE_PLUGIN_ACTIVATES_ON methods or channels. No-op if already initialized.
+    */
+   void activate_plugin(abstract_plugin& plug);
+
+   /**
+    * Replace the started plugin of the same name by `replacement`, see application_t::replace_plugin().
+    * On return or exception `replacement` holds the plugin to destroy: the replaced one, shut down, or, if
+    * replacing failed, `replacement` itself after the old instance has been started again.
+    */
+   void swap_plugin(std::unique_ptr<abstract_plugin>& replacement);
+
+   /// log an exception caught from `origin` without propagating it
+   void handle_exception(std::exception_ptr eptr, std::string_view origin);
+
+   /**
+    * Activates `plug` on the first use of Decl. Off the main thread activation runs on the main loop and the caller
+    * waits for it (unless quitting), so it finds the plugin's providers and subscriptions.
+    */
+   template <typename Decl>
+   void add_activation_trigger(abstract_plugin& plug) {
+      auto activate = [this, &plug]() {
+         if (std::this_thread::get_id() == main_thread.load(std::memory_order_relaxed)) {
+            activate_plugin(plug);
+         } else if (post_cb && !is_quiting()) {
+            auto done = std::make_shared<std::promise<void>>();
+            auto activated = done->get_future();
+            post_cb(priority::highest, [this, &plug, done]() {
+               activate_plugin(plug);
+               done->set_value();
+            });
+            activated.wait(); // also returns if the handler is discarded, or throws, when quitting
+         }
+      };
+      if constexpr (is_method_decl<Decl>::value) {
+         get_method<Decl>()._activation.add(std::move(activate));
+      } else {
+         static_assert(is_channel_decl<Decl>::value, "APPBASE_PLUGIN_ACTIVATES_ON expects method_decl or channel_decl types");
+         get_channel<Decl>()._activation.add(std::move(activate));
+      }
+   }
+
+   /**
+    * Run the main loop until done() returns true, for plugins whose plugin_startup() or plugin_shutdown() return
+    * a sender. During startup (`in_shutdown` false) it also returns when quit() is called.
+    */
+   template <typename F>
+   void run_until(F&& done, bool in_shutdown) {
+      while (!done()) {
+         if (!in_shutdown && is_quiting())
+            break;
+         run_one_cb();
+      }
+      if (!in_shutdown && is_quiting())
+         stop_executor_cb(); // in case run_one_cb() restarted the executor concurrently with quit()
+   }
+
+   /// bookkeeping of asynchronous plugin_startup(), all on the main thread
+   ///@{
+   uint32_t           pending_startups = 0;
+   std::exception_ptr startup_error;
+   ///@}
+
    application_base(std::shared_ptr<void>&& e); ///< protected because application is a singleton that should be accessed via instance()
 
    /// !!! must be dtor'ed after plugins
@@ -322,11 +483,22 @@ protected:
 private:
    // members are ordered taking into account that the last one is destructed first
    std::function<void()> sighup_callback;
+   std::atomic<std::thread::id> main_thread{std::this_thread::get_id()}; ///< constructing the application, then running exec()
    std::function<void()> stop_executor_cb;
    std::function<void(int, std::function<void()>)> post_cb;
+   std::function<void()> run_one_cb;
+   std::function<size_t(size_t)> prefault_handlers_cb;
+   profiler::tag_name_fn tag_name_cb;
 
    map<std::type_index, erased_method_ptr> methods;
    map<std::type_index, erased_channel_ptr> channels;
+   appbase::cache_budget cache_budget{size_t(1024) << 20};
+   map<string, std::unique_ptr<cache_base>, std::less<>> caches; ///< by name, destroyed before cache_budget
+   appbase::memory_pressure memory_monitor{[this](int priority, std::function<void()> f) {
+      if (post_cb)
+         post_cb(priority, std::move(f));
+   }};
+   appbase::memory_pressure::handle cache_shrinker; ///< caches shrink first under memory pressure
 
    std::unique_ptr<class application_impl> my;
 
@@ -343,8 +515,6 @@ private:
 
    void wait_for_signal(std::shared_ptr<boost::asio::signal_set> ss);
    std::shared_ptr<boost::asio::signal_set> setup_signal_handling_on_ioc(boost::asio::io_context& io_ctx, bool include_sighup);
-
-   void handle_exception(std::exception_ptr eptr, std::string_view origin);
 };
 
 // ------------------------------------------------------------------------------------------
@@ -400,13 +570,14 @@ public:
    /**
     * Create a timer with the main application io_context. Timer async_wait will execute on the main thread.
     *
-    * Use with app().executor().wrap(priority::x, exec_queue::x, [](const boost::system::error_code& ec).
+    * Use with app().executor().wrap(priority::x, [](const boost::system::error_code& ec).
     * For example:
-    *   _timer.async_wait(app().executor().wrap(priority::high, exec_queue::read_write,
+    *   _timer.async_wait(app().executor().wrap(priority::high,
     *                                           [](const boost::system::error_code& ec) {
     *                                              if (!ec)
     *                                                 // do something
     *                                           }));
+    * app().executor().wrap(func) runs the handler at the priority of the handler that started the wait.
     */
    template<typename Timer>
    auto make_timer() {
@@ -420,13 +591,109 @@ public:
    application_t() : application_base(std::make_shared<executor_t>()) {
       set_stop_executor_cb([&]() { get_io_context().stop(); });
       set_post_cb([&](int prio, std::function<void()> cb) { executor().post(prio, std::move(cb)); });
+      set_prefault_handlers_cb([&](size_t slabs) { return executor().get_priority_queue().prefault_handlers(slabs); });
+      set_tag_name_cb([&](execution_priority_queue::queue_tag tag) {
+         const auto& queue = executor().get_priority_queue();
+         return tag < queue.tag_count() ? queue.tag_name(tag) : std::string();
+      });
+      set_run_one_cb([&]() {
+         auto& io_ctx = get_io_context();
+         if (io_ctx.stopped()) // stopped by quit() before shutdown, or by running out of work outside of exec()
+            io_ctx.restart();
+         io_ctx.poll();
+         if (!executor().execute_highest()) {
+            // nothing queued, wait briefly e.g. for a completion from another thread
+            auto work = boost::asio::make_work_guard(io_ctx);
+            io_ctx.run_one_for(std::chrono::milliseconds(10));
+         }
+      });
    }
 
    executor_t& executor() const {
       return *static_cast<executor_t*>(executor_ptr.get());
    }
 
+   /**
+    * Replace a running plugin by a new instance of the same name (e.g. from a rebuilt shared library) without
+    * restarting the application. Must be called from the main thread.
+    *
+    * From the call on, handlers added under the plugin's queue tag are held back (see execution_priority_queue::hold())
+    * so that those already queued drain. Once none is left, in a single main loop handler (so no method call or
+    * channel dispatch can observe an intermediate state):
+    *   - the running instance's plugin_export_state() (optional, returning std::any) is called, then it is shut down
+    *   - `replacement` is initialized with the application options, given the state through plugin_import_state()
+    *     (optional, taking std::any), and started; it takes the place of the old instance in startup and
+    *     shutdown order, and registers its own method providers and channel subscriptions (the old instance must
+    *     release its own in plugin_shutdown())
+    *   - the old instance is destroyed after the handlers queued at that point have run
+    * The handlers held back are queued again before the old instance is shut down, or when the application quits
+    * first, in which case the replacement is abandoned.
+    *
+    * Other plugins must not keep references to a plugin that may be replaced; they should use its methods and
+    * channels. If `replacement` fails to initialize or start, it is shut down and discarded, and the old instance
+    * is initialized, given the state it exported and started again in its place, so a plugin that may be replaced
+    * must support being initialized again after plugin_shutdown().
+    *
+    * @param on_replaced invoked on the main thread once replacing has completed, with the exception that made it
+    *                    fail or nullptr; without it a failure is reported like an exception of a plugin, and the
+    *                    application keeps running
+    */
+   void replace_plugin(std::unique_ptr<abstract_plugin> replacement,
+                       std::function<void(std::exception_ptr)> on_replaced = {}) {
+      auto& queue = executor().get_priority_queue();
+      auto tag = queue.register_tag(replacement->name());
+      queue.hold(tag);
+      executor().post(priority::lowest, execution_priority_queue::default_tag,
+                      replace_step{*this, tag, std::move(replacement), std::move(on_replaced)});
+   }
+
+   /**
+    * Heap usage attributed to each queue tag by name (plugins by their name, "" for code outside of plugins), when
+    * the `heap-accounting` option is enabled. Allocation rates are the difference between two calls. Must be called
+    * from the main thread.
+    */
+   std::vector<std::pair<std::string, heap_accounting::usage>> heap_usage() const {
+      const auto& queue = executor().get_priority_queue();
+      const auto  usage = heap_accounting::snapshot();
+      const size_t n    = std::min(queue.tag_count(), heap_accounting::max_tags);
+      std::vector<std::pair<std::string, heap_accounting::usage>> result;
+      result.reserve(n);
+      for (size_t tag = 0; tag < n; ++tag)
+         result.emplace_back(queue.tag_name(tag), usage[tag]);
+      return result;
+   }
+
 private:
+   // re-queued at the lowest priority until the plugin's queued handlers have drained
+   struct replace_step {
+      application_t&                          app;
+      execution_priority_queue::queue_tag     tag;
+      std::unique_ptr<abstract_plugin>        replacement;
+      std::function<void(std::exception_ptr)> on_replaced;
+
+      void operator()() {
+         auto& queue = app.executor().get_priority_queue();
+         if (queue.pending(tag)) {
+            app.executor().post(priority::lowest, execution_priority_queue::default_tag, std::move(*this));
+            return;
+         }
+         // before shutting down, an asynchronous plugin_shutdown() completes through handlers under the tag
+         queue.release(tag);
+         std::exception_ptr error;
+         try {
+            app.swap_plugin(replacement);
+         } catch(...) {
+            error = std::current_exception();
+         }
+         app.executor().post(priority::lowest, execution_priority_queue::default_tag,
+                             [retired = std::shared_ptr<abstract_plugin>(std::move(replacement))]() {});
+         if (on_replaced)
+            on_replaced(error);
+         else if (error)
+            app.handle_exception(error, "replace_plugin");
+      }
+   };
+
    inline static std::unique_ptr<application_t> app_instance;
 };
 
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <appbase/execution.hpp>
+
 namespace appbase {
 
 static application& app();
@@ -26,6 +28,8 @@ public:
       if (_state == registered) {
          _state = initialized;
          static_cast<Impl*>(this)->plugin_requires([&](auto& plug) { plug.initialize(options); });
+         _tag = app().executor().get_priority_queue().register_tag(name());
+         execution_priority_queue::scoped_tag tag(_tag);
          static_cast<Impl*>(this)->plugin_initialize(options);
          // ilog( "initializing plugin ${name}", ("name",name()) );
          app().plugin_initialized(this);
@@ -35,12 +39,61 @@ public:
 
    virtual void handle_sighup() override {}
 
+   virtual std::any export_state() final {
+      if constexpr (has_export_state<Impl>::value)
+         return static_cast<Impl*>(this)->plugin_export_state();
+      else
+         return {};
+   }
+
+   virtual void import_state(std::any state) final {
+      if constexpr (has_import_state<Impl>::value)
+         static_cast<Impl*>(this)->plugin_import_state(std::move(state));
+   }
+
+   virtual void reset_stopped() final {
+      if (_state == stopped)
+         _state = registered;
+   }
+
+   virtual bool register_activation() final {
+      if constexpr (has_activates_on<Impl>::value) {
+         static_cast<Impl*>(this)->plugin_activates_on([&](auto* decl) {
+            app().template add_activation_trigger<std::decay_t<decltype(*decl)>>(*this);
+         });
+         return true;
+      } else {
+         return false;
+      }
+   }
+
    virtual void startup() final {
       if (_state == initialized) {
          _state = started;
          static_cast<Impl*>(this)->plugin_requires([&](auto& plug) { plug.startup(); });
+         // dependencies whose plugin_startup() returned a sender must have completed it
+         static_cast<Impl*>(this)->plugin_requires([&](auto& plug) {
+            app().run_until([&]() { return !plug._startup_pending || app().startup_error; }, false);
+         });
+         if (app().startup_error)
+            std::rethrow_exception(app().startup_error);
          app().plugin_started(this); // add to `running_plugins` before so it will be shutdown if we throw in `plugin_startup()`
-         static_cast<Impl*>(this)->plugin_startup();
+         execution_priority_queue::scoped_tag tag(_tag);
+         if constexpr (std::is_void_v<decltype(static_cast<Impl*>(this)->plugin_startup())>) {
+            static_cast<Impl*>(this)->plugin_startup();
+         } else {
+            // runs concurrently with the startup of other plugins, see application_base::startup()
+            _startup_pending = true;
+            ++app().pending_startups;
+            execution::start_detached(static_cast<Impl*>(this)->plugin_startup(), [this](std::exception_ptr e) {
+               app().executor().post(priority::highest, [this, e]() {
+                  _startup_pending = false;
+                  --app().pending_startups;
+                  if (e && !app().startup_error)
+                     app().startup_error = e;
+               });
+            });
+         }
          // some plugins (such as producer_plugin) may call `app().quit()` during startup (see `producer_plugin_impl::start_block()`.
          // this is not cause for immediate termination.
       }
@@ -48,30 +101,122 @@ public:
    }
 
    virtual void shutdown() final {
-      if (_state == started) {
+      // not while an asynchronous plugin_startup() is pending, see application_base::shutdown_plugins()
+      if (_state == started && !_startup_pending) {
          _state = stopped;
          // ilog( "shutting down plugin ${name}", ("name",name()) );
-         static_cast<Impl*>(this)->plugin_shutdown();
+         execution_priority_queue::scoped_tag tag(_tag);
+         if constexpr (std::is_void_v<decltype(static_cast<Impl*>(this)->plugin_shutdown())>) {
+            static_cast<Impl*>(this)->plugin_shutdown();
+         } else {
+            // plugins shut down one at a time, the main loop keeps running until this one has completed
+            auto result = std::make_shared<std::optional<std::exception_ptr>>();
+            execution::start_detached(static_cast<Impl*>(this)->plugin_shutdown(), [result](std::exception_ptr e) {
+               app().executor().post(priority::highest, [result, e]() { *result = e; });
+            });
+            app().run_until([&]() { return result->has_value(); }, true);
+            if (**result)
+               std::rethrow_exception(**result);
+         }
       }
    }
 
 protected:
    plugin(const string& name) : _name(name) {}
 
+   template <typename T, typename = void>
+   struct has_activates_on : std::false_type {};
+   template <typename T>
+   struct has_activates_on<T, std::void_t<decltype(std::declval<T&>().plugin_activates_on(std::declval<void (*)(void*)>()))>>
+      : std::true_type {};
+
+   template <typename T, typename = void>
+   struct has_export_state : std::false_type {};
+   template <typename T>
+   struct has_export_state<T, std::void_t<decltype(std::declval<T&>().plugin_export_state())>> : std::true_type {};
+
+   template <typename T, typename = void>
+   struct has_import_state : std::false_type {};
+   template <typename T>
+   struct has_import_state<T, std::void_t<decltype(std::declval<T&>().plugin_import_state(std::declval<std::any>()))>>
+      : std::true_type {};
+
+   /// tag attributed to handlers posted by this plugin, see execution_priority_queue::register_tag()
+   execution_priority_queue::queue_tag queue_tag() const {
+      return _tag;
+   }
+
+   /// logger named after this plugin, its level can be set with `log-level-for = <plugin name>=<level>`
+   appbase::logger& plugin_logger() const {
+      if (!_logger)
+         _logger = &get_logger(name());
+      return *_logger;
+   }
+
 private:
+   template <typename>
+   friend class plugin;
+
    state _state = abstract_plugin::registered;
    std::string _name;
+   execution_priority_queue::queue_tag _tag = execution_priority_queue::default_tag;
+   bool _startup_pending = false; ///< plugin_startup() returned a sender which has not completed
+   mutable appbase::logger* _logger = nullptr;
 };
 
 // ------------------------------------------------------------------------------------------
 template <typename Data, typename DispatchPolicy>
 void channel<Data, DispatchPolicy>::publish(int priority, const Data& data) {
-   if (has_subscribers()) {
+   _activation();
+   if (const size_t subscribers = _signal.num_slots()) {
+      // every subscriber is a stream with a full buffer which drops new messages
+      if (_streams->accepting.load() == 0 && _streams->streams.load() == subscribers) {
+         ++_streams->rejected;
+         return;
+      }
       // this will copy data into the lambda
-      app().executor().post(priority, [this, data]() { _signal(data); });
+      if (_deferred_reclaim)
+         app().executor().post(priority, reclaim_captures([this, data]() { _signal(data); }));
+      else
+         app().executor().post(priority, [this, data]() { _signal(data); });
    }
 }
 
+template <typename Data, typename DispatchPolicy>
+void channel<Data, DispatchPolicy>::publish(const Data& data) {
+   publish(priority::inherit(), data);
+}
+
+template <typename Data, typename DispatchPolicy>
+template <typename CompletionToken>
+auto channel<Data, DispatchPolicy>::stream::async_next(CompletionToken&& token) {
+   return boost::asio::async_initiate<CompletionToken, void(std::optional<Data>)>(
+      [this](auto handler) {
+         if (_state)
+            _state->next(std::move(handler));
+         else
+            app().executor().post(priority::inherit(), [h = std::move(handler)]() mutable { std::move(h)(std::optional<Data>{}); });
+      },
+      token);
+}
+
+template <typename Data, typename DispatchPolicy>
+template <typename Handler>
+void channel<Data, DispatchPolicy>::stream::state::resume(Handler&& handler, std::optional<Data> msg) {
+   app().executor().post(priority, [h = std::move(handler), msg = std::move(msg)]() mutable { std::move(h)(std::move(msg)); });
+}
+
+// ------------------------------------------------------------------------------------------
+/**
+ * Completion handler for asio async operations which completes directly into the application's priority queue
+ * at `priority`, see default_executor::use_priority().
+ */
+template <typename Handler, typename Executor = std::decay_t<decltype(app().executor())>>
+auto use_priority(int priority, Handler&& handler) {
+   Executor& exec = app().executor(); // dependent so executors without use_priority() can still be used with the rest of appbase
+   return exec.use_priority(priority, std::forward<Handler>(handler));
+}
+
 // ------------------------------------------------------------------------------------------
 class scoped_app {
 public:
@@ -0,0 +1,350 @@
+#pragma once
+
+#include <appbase/default_executor.hpp>
+
+#include <boost/asio.hpp>
+
+#include <cassert>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+namespace appbase {
+
+/**
+ * Asynchronous synchronization primitives which park continuations instead of blocking threads.
+ *
+ * Waits are asio async operations (callbacks, boost::asio::use_future, boost::asio::use_awaitable with C++20)
+ * with signature void(). Wakeups are posted to the executor at the priority and queue tag of the waiter, so the
+ * continuation runs on the main loop; waiters are woken highest priority first, FIFO within a priority.
+ * All member functions may be called from any thread.
+ *
+ * Example:
+ *   appbase::async_mutex m{app().executor()};
+ *   m.async_lock(priority::high, [&]() { update_state(); m.unlock(); });
+ */
+
+namespace detail {
+   class async_wait_queue {
+   public:
+      struct waiter {
+         waiter(int priority) : priority(priority), tag(execution_priority_queue::current_tag()) {}
+         virtual ~waiter() = default;
+         virtual void resume() = 0;
+
+         int                                 priority;
+         execution_priority_queue::queue_tag tag;
+      };
+      using waiter_ptr = std::unique_ptr<waiter>;
+
+      /// waiter posting `handler` to `exec` when resumed
+      template <typename Executor, typename Handler>
+      static waiter_ptr make_post(Executor& exec, int priority, Handler&& handler) {
+         struct post_waiter : waiter {
+            post_waiter(Executor& exec, int priority, Handler&& h) : waiter(priority), exec(exec), handler(std::move(h)) {}
+            void resume() override { exec.post(priority, tag, std::move(handler)); }
+            Executor& exec;
+            Handler   handler;
+         };
+         return std::make_unique<post_waiter>(exec, priority, std::move(handler));
+      }
+
+      void push(waiter_ptr w) {
+         auto itr = waiters_.begin();
+         while (itr != waiters_.end() && (*itr)->priority >= w->priority)
+            ++itr;
+         waiters_.insert(itr, std::move(w));
+      }
+
+      waiter_ptr pop() {
+         if (waiters_.empty())
+            return {};
+         waiter_ptr w = std::move(waiters_.front());
+         waiters_.pop_front();
+         return w;
+      }
+
+      std::list<waiter_ptr> take_all() { return std::move(waiters_); }
+
+      bool empty() const { return waiters_.empty(); }
+
+   private:
+      std::list<waiter_ptr> waiters_;
+   };
+} // namespace detail
+
+// ------------------------------------------------------------------------------------------
+/**
+ * Mutex acquired asynchronously; unlock() hands ownership directly to the highest priority waiter.
+ */
+template <typename Executor = default_executor>
+class async_mutex {
+public:
+   explicit async_mutex(Executor& exec) : exec_(exec) {}
+
+   async_mutex(const async_mutex&) = delete;
+   async_mutex& operator=(const async_mutex&) = delete;
+
+   /**
+    * Complete once the mutex is owned by the caller, who must then call unlock().
+    */
+   template <typename CompletionToken>
+   auto async_lock(int priority, CompletionToken&& token) {
+      return boost::asio::async_initiate<CompletionToken, void()>(
+         [this, priority](auto handler) {
+            auto w = detail::async_wait_queue::make_post(exec_, priority, std::move(handler));
+            {
+               std::lock_guard<std::mutex> g(mtx_);
+               if (locked_) {
+                  waiters_.push(std::move(w));
+                  return;
+               }
+               locked_ = true;
+            }
+            w->resume();
+         },
+         token);
+   }
+
+   /// async_lock() at the priority of the handler currently executing on this thread, see priority::inherit()
+   template <typename CompletionToken>
+   auto async_lock(CompletionToken&& token) {
+      return async_lock(priority::inherit(), std::forward<CompletionToken>(token));
+   }
+
+   bool try_lock() {
+      std::lock_guard<std::mutex> g(mtx_);
+      return !std::exchange(locked_, true);
+   }
+
+   void unlock() {
+      detail::async_wait_queue::waiter_ptr w;
+      {
+         std::lock_guard<std::mutex> g(mtx_);
+         assert(locked_);
+         w = waiters_.pop();
+         if (!w)
+            locked_ = false;
+      }
+      if (w)
+         w->resume();
+   }
+
+private:
+   Executor&                 exec_;
+   std::mutex                mtx_;
+   bool                      locked_ = false;
+   detail::async_wait_queue  waiters_;
+};
+
+// ------------------------------------------------------------------------------------------
+/**
+ * Counting semaphore acquired asynchronously.
+ */
+template <typename Executor = default_executor>
+class async_semaphore {
+public:
+   async_semaphore(Executor& exec, size_t count) : exec_(exec), count_(count) {}
+
+   async_semaphore(const async_semaphore&) = delete;
+   async_semaphore& operator=(const async_semaphore&) = delete;
+
+   /**
+    * Complete once a unit has been acquired, to be returned with release().
+    */
+   template <typename CompletionToken>
+   auto async_acquire(int priority, CompletionToken&& token) {
+      return boost::asio::async_initiate<CompletionToken, void()>(
+         [this, priority](auto handler) {
+            auto w = detail::async_wait_queue::make_post(exec_, priority, std::move(handler));
+            {
+               std::lock_guard<std::mutex> g(mtx_);
+               if (!count_ || !waiters_.empty()) {
+                  waiters_.push(std::move(w));
+                  return;
+               }
+               --count_;
+            }
+            w->resume();
+         },
+         token);
+   }
+
+   /// async_acquire() at the priority of the handler currently executing on this thread
+   template <typename CompletionToken>
+   auto async_acquire(CompletionToken&& token) {
+      return async_acquire(priority::inherit(), std::forward<CompletionToken>(token));
+   }
+
+   bool try_acquire() {
+      std::lock_guard<std::mutex> g(mtx_);
+      if (!count_ || !waiters_.empty())
+         return false;
+      --count_;
+      return true;
+   }
+
+   void release(size_t n = 1) {
+      std::list<detail::async_wait_queue::waiter_ptr> woken;
+      {
+         std::lock_guard<std::mutex> g(mtx_);
+         for (; n; --n) {
+            auto w = waiters_.pop();
+            if (!w)
+               break;
+            woken.push_back(std::move(w));
+         }
+         count_ += n;
+      }
+      for (auto& w : woken)
+         w->resume();
+   }
+
+   size_t available() const {
+      std::lock_guard<std::mutex> g(mtx_);
+      return count_;
+   }
+
+private:
+   Executor&                 exec_;
+   mutable std::mutex        mtx_;
+   size_t                    count_;
+   detail::async_wait_queue  waiters_;
+};
+
+// ------------------------------------------------------------------------------------------
+/**
+ * Manual reset event: waits complete once set(), until reset().
+ */
+template <typename Executor = default_executor>
+class async_event {
+public:
+   explicit async_event(Executor& exec) : exec_(exec) {}
+
+   async_event(const async_event&) = delete;
+   async_event& operator=(const async_event&) = delete;
+
+   template <typename CompletionToken>
+   auto async_wait(int priority, CompletionToken&& token) {
+      return boost::asio::async_initiate<CompletionToken, void()>(
+         [this, priority](auto handler) {
+            auto w = detail::async_wait_queue::make_post(exec_, priority, std::move(handler));
+            {
+               std::lock_guard<std::mutex> g(mtx_);
+               if (!set_) {
+                  waiters_.push(std::move(w));
+                  return;
+               }
+            }
+            w->resume();
+         },
+         token);
+   }
+
+   /// async_wait() at the priority of the handler currently executing on this thread
+   template <typename CompletionToken>
+   auto async_wait(CompletionToken&& token) {
+      return async_wait(priority::inherit(), std::forward<CompletionToken>(token));
+   }
+
+   void set() {
+      std::list<detail::async_wait_queue::waiter_ptr> woken;
+      {
+         std::lock_guard<std::mutex> g(mtx_);
+         set_ = true;
+         woken = waiters_.take_all();
+      }
+      for (auto& w : woken)
+         w->resume();
+   }
+
+   void reset() {
+      std::lock_guard<std::mutex> g(mtx_);
+      set_ = false;
+   }
+
+   bool is_set() const {
+      std::lock_guard<std::mutex> g(mtx_);
+      return set_;
+   }
+
+private:
+   Executor&                 exec_;
+   mutable std::mutex        mtx_;
+   bool                      set_ = false;
+   detail::async_wait_queue  waiters_;
+};
+
+// ------------------------------------------------------------------------------------------
+/**
+ * Condition variable used with an async_mutex.
+ */
+template <typename Executor = default_executor>
+class async_condition {
+public:
+   async_condition() = default;
+
+   async_condition(const async_condition&) = delete;
+   async_condition& operator=(const async_condition&) = delete;
+
+   /**
+    * Release `m`, which the caller must own, and complete once notified and `m` has been reacquired.
+    * As with std::condition_variable the caller should recheck its predicate.
+    */
+   template <typename CompletionToken>
+   auto async_wait(async_mutex<Executor>& m, int priority, CompletionToken&& token) {
+      return boost::asio::async_initiate<CompletionToken, void()>(
+         [this, &m, priority](auto handler) {
+            using handler_t = decltype(handler);
+            struct relock_waiter : detail::async_wait_queue::waiter {
+               relock_waiter(async_mutex<Executor>& m, int priority, handler_t&& h)
+                  : waiter(priority), m(m), handler(std::move(h)) {}
+               void resume() override {
+                  execution_priority_queue::scoped_tag t(tag);
+                  m.async_lock(priority, std::move(handler));
+               }
+               async_mutex<Executor>& m;
+               handler_t              handler;
+            };
+            {
+               std::lock_guard<std::mutex> g(mtx_);
+               waiters_.push(std::make_unique<relock_waiter>(m, priority, std::move(handler)));
+            }
+            m.unlock();
+         },
+         token);
+   }
+
+   /// async_wait() at the priority of the handler currently executing on this thread
+   template <typename CompletionToken>
+   auto async_wait(async_mutex<Executor>& m, CompletionToken&& token) {
+      return async_wait(m, priority::inherit(), std::forward<CompletionToken>(token));
+   }
+
+   void notify_one() {
+      detail::async_wait_queue::waiter_ptr w;
+      {
+         std::lock_guard<std::mutex> g(mtx_);
+         w = waiters_.pop();
+      }
+      if (w)
+         w->resume();
+   }
+
+   void notify_all() {
+      std::list<detail::async_wait_queue::waiter_ptr> woken;
+      {
+         std::lock_guard<std::mutex> g(mtx_);
+         woken = waiters_.take_all();
+      }
+      for (auto& w : woken)
+         w->resume();
+   }
+
+private:
+   std::mutex                mtx_;
+   detail::async_wait_queue  waiters_;
+};
+
+} // namespace appbase
@@ -0,0 +1,407 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace appbase {
+
+class cache_budget;
+
+/**
+ * Statistics of a cache, summed over its shards
+ */
+struct cache_stats {
+   uint64_t hits       = 0;
+   uint64_t misses     = 0;
+   uint64_t inserts    = 0;
+   uint64_t evictions  = 0; ///< entries evicted to make room, by this cache or by the budget for another cache
+   uint64_t rejections = 0; ///< inserts refused by admission or because the budget could not make room
+   size_t   entries    = 0;
+   size_t   bytes      = 0; ///< charged against the budget
+};
+
+/**
+ * Type erased part of a sharded_cache, through which the cache_budget evicts entries
+ */
+class cache_base {
+public:
+   cache_base(std::string name, cache_budget& budget);
+   virtual ~cache_base();
+
+   cache_base(const cache_base&) = delete;
+   cache_base& operator=(const cache_base&) = delete;
+
+   const std::string& name() const { return name_; }
+
+   /// bytes currently charged
+   size_t bytes() const { return bytes_.load(std::memory_order_relaxed); }
+
+   virtual cache_stats stats() const = 0;
+
+   /**
+    * Evict entries until `bytes` have been freed, skipping shards locked by other threads and `locked_shard`.
+    * @return the bytes freed
+    */
+   virtual size_t evict(size_t bytes, const void* locked_shard) = 0;
+
+protected:
+   cache_budget&       budget_;
+   std::atomic<size_t> bytes_{0};
+
+private:
+   std::string name_;
+};
+
+/**
+ * Byte budget shared by every cache of the application, configured by the `cache-budget-mb` option.
+ *
+ * A cache inserting while the budget is exhausted evicts its own entries if it holds at least its fair share
+ * (the limit divided by the number of caches); otherwise entries are evicted from the cache furthest above its
+ * share. Concurrent inserts may exceed the limit by the size of the entries being inserted. A cache must not be
+ * destroyed while others may evict from it, those obtained with app().get_cache() live as long as the application.
+ */
+class cache_budget {
+public:
+   explicit cache_budget(size_t limit) : limit_(limit) {}
+
+   cache_budget(const cache_budget&) = delete;
+   cache_budget& operator=(const cache_budget&) = delete;
+
+   void set_limit(size_t bytes) { limit_.store(bytes, std::memory_order_relaxed); }
+   size_t limit() const { return limit_.load(std::memory_order_relaxed); }
+   size_t used() const { return used_.load(std::memory_order_relaxed); }
+
+   /// bytes by which charging `bytes` more would exceed the limit, 0 if they fit
+   size_t overflow(size_t bytes) const {
+      const size_t total = used() + bytes;
+      return total > limit() ? total - limit() : 0;
+   }
+
+   void charge(size_t bytes) { used_.fetch_add(bytes, std::memory_order_relaxed); }
+   void release(size_t bytes) { used_.fetch_sub(bytes, std::memory_order_relaxed); }
+
+   /// share of the limit each cache may hold before its own inserts evict its own entries
+   size_t fair_share() const;
+
+   /**
+    * Evict up to `bytes` from the cache furthest above its fair share, other than `requester`
+    * @return the bytes freed
+    */
+   size_t evict_for(const cache_base& requester, size_t bytes, const void* locked_shard);
+
+   /**
+    * Evict up to `bytes` from all caches, the largest first, e.g. under memory pressure
+    * @return the bytes freed
+    */
+   size_t shrink(size_t bytes);
+
+   /// stats of every cache by name
+   std::vector<std::pair<std::string, cache_stats>> stats() const;
+
+private:
+   friend class cache_base;
+   void add(cache_base* c);
+   void remove(cache_base* c);
+
+   std::atomic<size_t>      limit_;
+   std::atomic<size_t>      used_{0};
+   mutable std::mutex       mtx_;
+   std::vector<cache_base*> caches_;
+};
+
+namespace detail {
+   /**
+    * Count-min sketch of counters saturating at 15 estimating recent access frequencies (TinyLFU), halved
+    * periodically so that old popularity fades
+    */
+   class frequency_sketch {
+   public:
+      static constexpr size_t width = 1024; // counters per row, a power of 2
+
+      void increment(size_t hash) {
+         for (size_t row = 0; row < rows; ++row) {
+            uint8_t& c = counters_[row * width + index(hash, row)];
+            if (c < 15)
+               ++c;
+         }
+         if (++additions_ >= 10 * width)
+            age();
+      }
+
+      uint8_t estimate(size_t hash) const {
+         uint8_t f = 15;
+         for (size_t row = 0; row < rows; ++row)
+            f = std::min(f, counters_[row * width + index(hash, row)]);
+         return f;
+      }
+
+   private:
+      static constexpr size_t rows = 4;
+
+      static size_t index(size_t hash, size_t row) {
+         static constexpr uint64_t seeds[rows] = {0x9e3779b97f4a7c15ull, 0xc2b2ae3d27d4eb4full, 0x165667b19e3779f9ull,
+                                                  0x27d4eb2f165667c5ull};
+         uint64_t h = (uint64_t(hash) + seeds[row]) * seeds[(row + 1) % rows];
+         return (h >> 32) & (width - 1);
+      }
+
+      void age() {
+         for (auto& c : counters_)
+            c >>= 1;
+         additions_ /= 2;
+      }
+
+      std::vector<uint8_t> counters_ = std::vector<uint8_t>(rows * width);
+      size_t               additions_ = 0;
+   };
+} // namespace detail
+
+/**
+ * Concurrent cache of `Value`s by `Key` split into independently locked shards, accounted against a cache_budget.
+ *
+ * Each shard evicts with CLOCK (an entry read since the hand last passed it gets a second chance) and admits a new
+ * entry displacing a victim only if it is accessed more frequently according to a TinyLFU sketch, so that a scan of
+ * one-off keys does not flush the popular ones. Values are copied out; use a shared_ptr<const T> for large values.
+ *
+ * Obtained by name with app().get_cache<Key, Value>("name"), which is shared by every plugin using that name.
+ */
+template <typename Key, typename Value, typename Hash = std::hash<Key>>
+class sharded_cache final : public cache_base {
+public:
+   sharded_cache(std::string name, cache_budget& budget, size_t shards = 16)
+      : cache_base(std::move(name), budget), shards_(std::max<size_t>(1, shards)) {}
+
+   ~sharded_cache() override {
+      clear();
+   }
+
+   /// bytes charged for an entry when insert() is not given its size
+   static constexpr size_t default_charge = sizeof(Key) + sizeof(Value) + 64;
+
+   std::optional<Value> get(const Key& key) {
+      const size_t h = hash_(key);
+      auto&        s = shard_for(h);
+      std::lock_guard<std::mutex> g(s.mtx);
+      s.sketch.increment(h);
+      auto itr = s.index.find(key);
+      if (itr == s.index.end()) {
+         ++s.stats.misses;
+         return {};
+      }
+      ++s.stats.hits;
+      auto& e      = s.slots[itr->second];
+      e.referenced = true;
+      return e.value;
+   }
+
+   /**
+    * Insert or replace the entry of `key`, charged `charge` bytes (its approximate memory use).
+    * @return false if it was not admitted, a less frequently used entry of an exhausted budget or larger than it;
+    *         an entry being replaced is then kept
+    */
+   bool insert(const Key& key, Value value, size_t charge = default_charge) {
+      const size_t h = hash_(key);
+      auto&        s = shard_for(h);
+      std::lock_guard<std::mutex> g(s.mtx);
+
+      auto existing = s.index.find(key);
+      if (existing != s.index.end())
+         return replace(s, h, existing->second, std::move(value), charge);
+
+      if (!make_room(s, h, charge)) {
+         ++s.stats.rejections;
+         return false;
+      }
+
+      size_t slot;
+      if (!s.free.empty()) {
+         slot = s.free.back();
+         s.free.pop_back();
+      } else {
+         slot = s.slots.size();
+         s.slots.emplace_back();
+      }
+      auto& e      = s.slots[slot];
+      e.key.emplace(key);
+      e.value      = std::move(value);
+      e.charge     = charge;
+      e.referenced = false;
+      s.index.emplace(key, slot);
+      s.bytes += charge;
+      bytes_.fetch_add(charge, std::memory_order_relaxed);
+      budget_.charge(charge);
+      ++s.stats.inserts;
+      return true;
+   }
+
+   bool erase(const Key& key) {
+      auto&                       s = shard_for(hash_(key));
+      std::lock_guard<std::mutex> g(s.mtx);
+      auto                        itr = s.index.find(key);
+      if (itr == s.index.end())
+         return false;
+      remove(s, itr->second);
+      return true;
+   }
+
+   void clear() {
+      for (auto& s : shards_) {
+         std::lock_guard<std::mutex> g(s.mtx);
+         for (size_t i = 0; i < s.slots.size(); ++i)
+            if (s.slots[i].key)
+               remove(s, i);
+      }
+   }
+
+   cache_stats stats() const override {
+      cache_stats total;
+      for (const auto& s : shards_) {
+         std::lock_guard<std::mutex> g(s.mtx);
+         total.hits += s.stats.hits;
+         total.misses += s.stats.misses;
+         total.inserts += s.stats.inserts;
+         total.evictions += s.stats.evictions;
+         total.rejections += s.stats.rejections;
+         total.entries += s.index.size();
+         total.bytes += s.bytes;
+      }
+      return total;
+   }
+
+   size_t evict(size_t bytes, const void* locked_shard) override {
+      size_t       freed = 0;
+      const size_t start = next_shard_.fetch_add(1, std::memory_order_relaxed);
+      for (size_t i = 0; i < shards_.size() && freed < bytes; ++i) {
+         auto& s = shards_[(start + i) % shards_.size()];
+         if (&s == locked_shard)
+            continue;
+         std::unique_lock<std::mutex> g(s.mtx, std::try_to_lock);
+         if (!g.owns_lock())
+            continue;
+         while (freed < bytes && !s.index.empty())
+            freed += evict_one(s, victim(s));
+      }
+      return freed;
+   }
+
+private:
+   struct entry {
+      std::optional<Key> key; ///< empty for a free slot
+      Value              value{};
+      size_t             charge     = 0;
+      bool               referenced = false;
+   };
+
+   struct shard {
+      mutable std::mutex                      mtx;
+      std::unordered_map<Key, size_t, Hash>   index; ///< slot of each key
+      std::vector<entry>                      slots;
+      std::vector<size_t>                     free;
+      size_t                                  hand  = 0;
+      size_t                                  bytes = 0;
+      detail::frequency_sketch                sketch;
+      cache_stats                             stats;
+   };
+
+   shard& shard_for(size_t hash) {
+      // the high bits, std::hash of integers being the identity
+      return shards_[(uint64_t(hash) * 0x9e3779b97f4a7c15ull >> 32) % shards_.size()];
+   }
+
+   void remove(shard& s, size_t slot) {
+      auto& e = s.slots[slot];
+      s.index.erase(*e.key);
+      e.key.reset();
+      e.value = Value{};
+      s.bytes -= e.charge;
+      bytes_.fetch_sub(e.charge, std::memory_order_relaxed);
+      budget_.release(e.charge);
+      s.free.push_back(slot);
+   }
+
+   /// replace the value of the entry in `slot`, making room only for the growth of its charge
+   bool replace(shard& s, size_t hash, size_t slot, Value value, size_t charge) {
+      const size_t old_charge = s.slots[slot].charge;
+      if (charge > old_charge && !make_room(s, hash, charge - old_charge, slot)) {
+         ++s.stats.rejections;
+         return false;
+      }
+      auto& e      = s.slots[slot];
+      e.value      = std::move(value);
+      e.charge     = charge;
+      e.referenced = true;
+      s.bytes      = s.bytes - old_charge + charge;
+      if (charge >= old_charge) {
+         bytes_.fetch_add(charge - old_charge, std::memory_order_relaxed);
+         budget_.charge(charge - old_charge);
+      } else {
+         bytes_.fetch_sub(old_charge - charge, std::memory_order_relaxed);
+         budget_.release(old_charge - charge);
+      }
+      ++s.stats.inserts;
+      return true;
+   }
+
+   static constexpr size_t no_slot = SIZE_MAX;
+
+   /// advance the CLOCK hand to the next entry, other than `keep`, not referenced since it last passed, clearing the
+   /// reference bits
+   size_t victim(shard& s, size_t keep = no_slot) {
+      while (true) {
+         s.hand  = s.hand + 1 < s.slots.size() ? s.hand + 1 : 0;
+         auto& e = s.slots[s.hand];
+         if (!e.key || s.hand == keep)
+            continue;
+         if (!e.referenced)
+            return s.hand;
+         e.referenced = false;
+      }
+   }
+
+   size_t evict_one(shard& s, size_t slot) {
+      const size_t charge = s.slots[slot].charge;
+      remove(s, slot);
+      ++s.stats.evictions;
+      return charge;
+   }
+
+   /// evict entries, but not the one in `keep`, until `charge` more bytes fit in the budget
+   bool make_room(shard& s, size_t hash, size_t charge, size_t keep = no_slot) {
+      if (charge > budget_.limit())
+         return false;
+      size_t need = budget_.overflow(charge);
+      if (!need)
+         return true;
+      if (bytes() < budget_.fair_share()) {
+         // below its share: space is taken from the caches above theirs
+         const size_t freed = budget_.evict_for(*this, need, &s);
+         need               = freed >= need ? 0 : budget_.overflow(charge);
+      }
+      const uint8_t frequency = s.sketch.estimate(hash);
+      while (need && s.index.size() > (keep == no_slot ? 0 : 1)) {
+         const size_t slot = victim(s, keep);
+         if (frequency <= s.sketch.estimate(hash_(*s.slots[slot].key)))
+            return false;
+         const size_t freed = evict_one(s, slot);
+         need               = freed >= need ? 0 : need - freed;
+      }
+      if (need)
+         need -= std::min(need, evict(need, &s));
+      return need == 0;
+   }
+
+   Hash                 hash_;
+   std::vector<shard>   shards_;
+   std::atomic<size_t>  next_shard_{0};
+};
+
+} // namespace appbase
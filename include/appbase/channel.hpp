@@ -8,9 +8,29 @@
 #include <boost/signals2.hpp>
 #include <boost/exception/diagnostic_information.hpp>
 
+#include <appbase/activation_hook.hpp>
+#include <appbase/execution_priority_queue.hpp>
+#include <appbase/heap_accounting.hpp>
+#include <appbase/reclaimer.hpp>
+
+#include <atomic>
+#include <cassert>
+#include <memory>
+#include <memory_resource>
+#include <optional>
+#include <vector>
+
 namespace appbase {
    class application_base;
 
+   /**
+    * What a channel stream does with a message published while its buffer is full
+    */
+   enum class stream_overflow {
+      drop_oldest, ///< evict the oldest buffered message to make room
+      drop_newest  ///< discard the message being published
+   };
+
    using erased_channel_ptr = std::unique_ptr<void, void(*)(void*)>;
 
    /**
@@ -93,6 +113,187 @@ namespace appbase {
                friend class channel;
          };
 
+         /**
+          * Subscription buffering messages in a bounded ring, consumed with async_next() instead of a callback
+          * invoked per message. A full buffer drops messages according to its stream_overflow policy and counts
+          * them, bounding memory when the consumer falls behind. While every subscriber of the channel is a full
+          * drop_newest stream, publish() drops messages without posting them to the main loop.
+          *
+          * Messages are buffered on the main thread; async_next(), try_next() and close() must also be called
+          * from the main thread.
+          */
+         class stream {
+            public:
+               stream() = default;
+               stream(stream&&) = default;
+               stream& operator= (stream&& rhs) {
+                  close();
+                  _state = std::move(rhs._state);
+                  _handle = std::move(rhs._handle);
+                  return *this;
+               }
+
+               ~stream() {
+                  close();
+               }
+
+               /**
+                * Wait for the next message. The completion signature is void(std::optional<Data>); an empty optional
+                * means the stream is closed and drained. Completion is posted to the priority queue at the priority
+                * given to subscribe_stream(), never invoked from within async_next().
+                * At most one async_next() may be outstanding.
+                *
+                * Example (C++20):
+                *   while (auto msg = co_await sub.async_next(boost::asio::use_awaitable)) { ... }
+                */
+               template <typename CompletionToken>
+               auto async_next(CompletionToken&& token);
+
+               /**
+                * Pop the next buffered message if any, for draining a batch after async_next() completes
+                */
+               std::optional<Data> try_next() {
+                  return _state ? _state->pop() : std::optional<Data>{};
+               }
+
+               /// number of buffered messages
+               size_t size() const { return _state ? _state->count : 0; }
+
+               /// maximum number of buffered messages
+               size_t capacity() const { return _state ? _state->ring.size() : 0; }
+
+               /// number of messages dropped because the buffer was full
+               uint64_t dropped() const { return _state ? _state->total_dropped() : 0; }
+
+               /**
+                * Unsubscribe from the channel. Buffered messages may still be consumed, after which async_next()
+                * completes with an empty optional.
+                */
+               void close() {
+                  if (_handle.connected())
+                     _handle.disconnect();
+                  if (_state && !_state->closed) {
+                     _state->dropped = _state->total_dropped();
+                     _state->closed  = true;
+                     _state->update_accepting();
+                     --_state->counters->streams;
+                     if (auto w = std::move(_state->pending))
+                        w->complete(*_state, std::nullopt);
+                  }
+               }
+
+            private:
+               struct state;
+
+               /// shared by a channel and its streams, so that publish() need not post messages no stream can take
+               struct counters {
+                  std::atomic<size_t>   streams{0};   ///< open streams
+                  std::atomic<size_t>   accepting{0}; ///< open streams which would buffer a message now
+                  std::atomic<uint64_t> rejected{0};  ///< messages publish() dropped as no subscriber could take them
+               };
+
+               struct waiter_base {
+                  virtual ~waiter_base() = default;
+                  virtual void complete(state& st, std::optional<Data> msg) = 0;
+               };
+
+               template <typename Handler>
+               struct waiter : waiter_base {
+                  explicit waiter(Handler&& h) : handler(std::move(h)) {}
+                  void complete(state& st, std::optional<Data> msg) override { st.resume(std::move(handler), std::move(msg)); }
+                  Handler handler;
+               };
+
+               struct state {
+                  state(int priority, size_t capacity, stream_overflow overflow, std::pmr::memory_resource* resource,
+                        std::shared_ptr<stream::counters> c)
+                  : ring(capacity, resource), priority(priority), overflow(overflow), counters(std::move(c)) {
+                     ++counters->streams;
+                     ++counters->accepting;
+                  }
+
+                  void push(const Data& data) {
+                     if (closed)
+                        return;
+                     if (auto w = std::move(pending)) {
+                        w->complete(*this, data);
+                     } else if (count < ring.size()) {
+                        ring[(head + count++) % ring.size()] = data;
+                     } else {
+                        ++dropped;
+                        if (overflow == stream_overflow::drop_oldest) {
+                           ring[head] = data;
+                           head = (head + 1) % ring.size();
+                        }
+                     }
+                     update_accepting();
+                  }
+
+                  std::optional<Data> pop() {
+                     if (!count)
+                        return {};
+                     std::optional<Data> r = std::move(ring[head]);
+                     ring[head].reset();
+                     head = (head + 1) % ring.size();
+                     --count;
+                     update_accepting();
+                     return r;
+                  }
+
+                  /// keep counters->accepting in step with whether this stream would buffer a message now
+                  void update_accepting() {
+                     const bool now = !closed && (overflow == stream_overflow::drop_oldest || count < ring.size());
+                     if (now == accepting)
+                        return;
+                     accepting = now;
+                     if (now) {
+                        ++counters->accepting;
+                        dropped += counters->rejected.load() - rejected_base;
+                     } else {
+                        rejected_base = counters->rejected.load();
+                        --counters->accepting;
+                     }
+                  }
+
+                  uint64_t total_dropped() const {
+                     return dropped + (accepting || closed ? 0 : counters->rejected.load() - rejected_base);
+                  }
+
+                  template <typename Handler>
+                  void next(Handler&& handler) {
+                     assert(!pending); // only one async_next() may be outstanding
+                     if (!count && !closed)
+                        pending = std::make_unique<stream::waiter<Handler>>(std::move(handler));
+                     else
+                        resume(std::move(handler), pop());
+                  }
+
+                  template <typename Handler>
+                  void resume(Handler&& handler, std::optional<Data> msg);
+
+                  std::pmr::vector<std::optional<Data>> ring;
+                  size_t                                head = 0;
+                  size_t                                count = 0;
+                  int                                   priority;
+                  stream_overflow                       overflow;
+                  uint64_t                              dropped = 0;
+                  bool                                  closed = false;
+                  std::unique_ptr<waiter_base>          pending; // handler of an async_next() waiting for a message
+                  std::shared_ptr<stream::counters>     counters;
+                  bool                                  accepting = true; ///< counted in counters->accepting
+                  uint64_t                              rejected_base = 0; ///< counters->rejected once it stopped accepting
+               };
+
+               stream(std::shared_ptr<state> st, boost::signals2::connection&& h)
+               :_state(std::move(st)), _handle(std::move(h))
+               {}
+
+               std::shared_ptr<state>      _state;
+               boost::signals2::connection _handle;
+
+               friend class channel;
+         };
+
          /**
           * Publish data to a channel.  This data is *copied* on publish.
           * @param priority - the priority to use for post
@@ -101,14 +302,63 @@ namespace appbase {
          void publish(int priority, const Data& data);
 
          /**
-          * subscribe to data on a channel
+          * Publish data to a channel at the priority of the handler currently executing on this thread,
+          * see priority::inherit(). This data is *copied* on publish.
+          * @param data - the data to publish
+          */
+         void publish(const Data& data);
+
+         /**
+          * subscribe to data on a channel, the callback runs under the queue tag of the subscriber (e.g. its plugin)
+          * when heap_accounting is enabled, and under the publisher's otherwise
           * @tparam Callback the type of the callback (functor|lambda)
           * @param cb the callback
           * @return handle to the subscription
           */
          template<typename Callback>
          handle subscribe(Callback cb) {
-            return handle(_signal.connect(cb));
+            _activation();
+            if constexpr (std::is_base_of_v<boost::signals2::slot_base, Callback>)
+               return handle(_signal.connect(cb)); // keeps the objects it tracks
+            else if (heap_accounting::enabled())
+               return handle(_signal.connect(execution_priority_queue::bind_current_tag(std::move(cb))));
+            else
+               return handle(_signal.connect(std::move(cb)));
+         }
+
+         /**
+          * subscribe to data on a channel with a bounded buffer consumed through stream::async_next()
+          * @param priority - the priority at which async_next() completions run
+          * @param capacity - the maximum number of buffered messages, must be > 0
+          * @param overflow - what to drop when a message arrives while the buffer is full, there is no default as
+          *                   either loses messages
+          * @return the stream, which unsubscribes when destroyed
+          */
+         stream subscribe_stream(int priority, size_t capacity, stream_overflow overflow) {
+            assert(capacity > 0);
+            _activation();
+            auto st = std::allocate_shared<typename stream::state>(
+               std::pmr::polymorphic_allocator<typename stream::state>(_resource), priority, capacity, overflow, _resource,
+               _streams);
+            auto conn = _signal.connect([st](const Data& data) { st->push(data); });
+            return stream(std::move(st), std::move(conn));
+         }
+
+         /**
+          * Allocate the buffers of streams subscribed after this call from `resource`, which must outlive them.
+          * The data copied by publish() is stored with the queued handler, see default_executor::set_memory_resource().
+          * Subscriber lists are managed by boost::signals2 and always use the global heap.
+          */
+         void set_memory_resource(std::pmr::memory_resource* resource) {
+            _resource = resource;
+         }
+
+         /**
+          * Destroy the data copied by publish() on the reclaimer's thread once it has been dispatched, rather than
+          * on the main loop, for messages expensive to free. See appbase::reclaimer.
+          */
+         void set_deferred_reclaim(bool enable) {
+            _deferred_reclaim = enable;
          }
 
          /**
@@ -170,6 +420,10 @@ namespace appbase {
          }
 
          boost::signals2::signal<void(const Data&), DispatchPolicy> _signal;
+         activation_hook _activation; ///< activates lazy plugins on first subscribe or publish
+         std::pmr::memory_resource* _resource = std::pmr::get_default_resource(); ///< for stream buffers
+         bool _deferred_reclaim = false; ///< publish() retires its copy of the data to the reclaimer
+         std::shared_ptr<typename stream::counters> _streams = std::make_shared<typename stream::counters>();
 
          friend class appbase::application_base;
    };
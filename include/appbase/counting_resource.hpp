@@ -0,0 +1,56 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+
+namespace appbase {
+
+/**
+ * std::pmr::memory_resource forwarding to `upstream` while counting what goes through it, to measure the memory
+ * appbase allocates for handlers and channel streams.
+ *
+ * Example:
+ *   static appbase::counting_resource appbase_memory;
+ *   app().executor().set_memory_resource(&appbase_memory);
+ *   ...
+ *   APPBASE_ILOG(appbase::get_logger("memory"), "appbase holds {} bytes", appbase_memory.bytes_in_use());
+ */
+class counting_resource : public std::pmr::memory_resource {
+public:
+   explicit counting_resource(std::pmr::memory_resource* upstream = std::pmr::get_default_resource())
+      : upstream_(upstream) {}
+
+   size_t bytes_in_use() const { return bytes_.load(std::memory_order_relaxed); }
+   size_t peak_bytes() const { return peak_.load(std::memory_order_relaxed); }
+   uint64_t allocations() const { return allocations_.load(std::memory_order_relaxed); }
+
+   std::pmr::memory_resource* upstream() const { return upstream_; }
+
+private:
+   void* do_allocate(size_t bytes, size_t alignment) override {
+      void* p = upstream_->allocate(bytes, alignment);
+      allocations_.fetch_add(1, std::memory_order_relaxed);
+      const size_t now = bytes_.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+      size_t peak = peak_.load(std::memory_order_relaxed);
+      while (now > peak && !peak_.compare_exchange_weak(peak, now, std::memory_order_relaxed)) {}
+      return p;
+   }
+
+   void do_deallocate(void* p, size_t bytes, size_t alignment) override {
+      upstream_->deallocate(p, bytes, alignment);
+      bytes_.fetch_sub(bytes, std::memory_order_relaxed);
+   }
+
+   bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+      return this == &other;
+   }
+
+   std::pmr::memory_resource* upstream_;
+   std::atomic<size_t>        bytes_{0};
+   std::atomic<size_t>        peak_{0};
+   std::atomic<uint64_t>      allocations_{0};
+};
+
+} // namespace appbase
@@ -2,18 +2,237 @@
 
 #include <appbase/application_base.hpp>
 #include <appbase/execution_priority_queue.hpp>
+#include <appbase/qsbr.hpp>
+#include <appbase/safepoint.hpp>
 
+#include <atomic>
+#include <cstddef>
 #include <limits>
+#include <memory_resource>
+#include <string>
+#include <iterator>
+#include <vector>
 
 namespace appbase {
 
 class default_executor {
 public:
+   default_executor() {
+      // a main loop blocked waiting for work returns from io_context::run_one() to announce its quiescent state
+      qsbr_waker = domain.add_waker([this]() { boost::asio::post(io_ctx, []() {}); });
+   }
+
+   ~default_executor() {
+      domain.remove_waker(qsbr_waker);
+   }
+
    template <typename Func>
    auto post(int priority, Func&& func) {
+      if (auto* r = resource.load(std::memory_order_relaxed))
+         return boost::asio::post(io_ctx, pri_queue.wrap(priority, --order, allocating_handler<std::decay_t<Func>>{std::forward<Func>(func), r}));
       return boost::asio::post(io_ctx, pri_queue.wrap(priority, --order, std::forward<Func>(func)));
    }
 
+   /**
+    * Post all callables of `funcs` at `priority` with a single io_context post (one synchronization and one wakeup)
+    * instead of one per callable. They are queued in range order and keep FIFO ordering with other posts.
+    * Callables are moved out of `funcs` when it is an rvalue, copied otherwise.
+    */
+   template <typename Range>
+   void post_bulk(int priority, Range&& funcs) {
+      using func_t = std::decay_t<decltype(*std::begin(funcs))>;
+      std::vector<func_t> v;
+      if constexpr (std::is_rvalue_reference_v<Range&&>)
+         v.assign(std::make_move_iterator(std::begin(funcs)), std::make_move_iterator(std::end(funcs)));
+      else
+         v.assign(std::begin(funcs), std::end(funcs));
+      if (v.empty())
+         return;
+      const size_t first = order - 1;
+      order -= v.size();
+      post_to_context([this, priority, first, tag = execution_priority_queue::current_tag(), v = std::move(v)]() mutable {
+         pri_queue.add_bulk(priority, first, tag, std::move(v));
+      });
+   }
+
+   /**
+    * Completion handler created by use_priority().
+    */
+   template <typename Handler>
+   class priority_handler {
+   public:
+      priority_handler(default_executor& e, int priority, Handler h)
+         : exec(&e), priority(priority), tag(execution_priority_queue::current_tag()), handler(std::move(h)) {}
+
+      template <typename... Args>
+      void operator()(Args&&... args) {
+         exec->pri_queue.dispatch(priority, --exec->order, tag,
+                                  [h = std::move(handler), args = std::make_tuple(std::forward<Args>(args)...)]() mutable {
+                                     std::apply(std::move(h), std::move(args));
+                                  });
+      }
+
+   private:
+      default_executor*                   exec;
+      int                                 priority;
+      execution_priority_queue::queue_tag tag;
+      Handler                             handler;
+   };
+
+   /**
+    * Wrap `handler` so that, used as the completion handler of an asio async operation on the main io_context,
+    * its completion is placed directly into the priority queue at `priority`. Handler storage is recycled by the
+    * queue so no allocation is made per completion in steady state. When invoked from a handler already running
+    * at an equal or higher priority the handler runs inline, see execution_priority_queue::can_run_inline().
+    *
+    * Example:
+    *   socket.async_read_some(buf, app().executor().use_priority(priority::high, [](const auto& ec, size_t n) { ... }));
+    */
+   template <typename Handler>
+   priority_handler<std::decay_t<Handler>> use_priority(int priority, Handler&& handler) {
+      return {*this, priority, std::forward<Handler>(handler)};
+   }
+
+   /**
+    * Handle to a handler posted with post_with_handle(), used to change its priority or cancel it while it is
+    * still queued. May be used from any thread; changes are applied on the main thread.
+    */
+   class task_handle {
+   public:
+      task_handle() = default;
+
+      /// Raise or lower the priority of the handler if it has not started executing yet.
+      void set_priority(int priority) {
+         apply([priority](execution_priority_queue& q, execution_priority_queue::task& t) { q.set_priority(t, priority); });
+      }
+
+      /// Drop the handler without executing it if it has not started executing yet.
+      void cancel() {
+         apply([](execution_priority_queue& q, execution_priority_queue::task& t) { q.cancel(t); });
+      }
+
+      explicit operator bool() const { return !!task; }
+
+   private:
+      friend class default_executor;
+      task_handle(default_executor& e, std::shared_ptr<execution_priority_queue::task> t) : exec(&e), task(std::move(t)) {}
+
+      template <typename F>
+      void apply(F&& f) {
+         if (!task)
+            return;
+         if (exec->pri_queue.running_in_this_thread())
+            f(exec->pri_queue, *task);
+         else
+            exec->post_to_context([q = &exec->pri_queue, t = task, f]() { f(*q, *t); });
+      }
+
+      default_executor*                                exec = nullptr;
+      std::shared_ptr<execution_priority_queue::task> task;
+   };
+
+   /**
+    * Same as post() but returns a task_handle through which the handler can be reprioritized or cancelled
+    * while it is queued, e.g. when background work becomes urgent because a client is waiting on it.
+    */
+   template <typename Func>
+   task_handle post_with_handle(int priority, Func&& func) {
+      auto t = std::make_shared<execution_priority_queue::task>(priority);
+      post_to_context([this, t, o = --order, tag = execution_priority_queue::current_tag(), f = std::forward<Func>(func)]() mutable {
+         pri_queue.add_tracked(o, tag, std::move(f), t);
+      });
+      return task_handle(*this, std::move(t));
+   }
+
+   /**
+    * Post func unless a handler posted with the same `key` is still queued, coalescing redundant work such as
+    * "recompute X" notifications. Deduplication happens when the handler reaches the priority queue.
+    *
+    * @param dup drop the new func (default) or run it in place of the queued handler
+    * @param raise_priority move the queued handler up to `priority` if that is higher than its own
+    */
+   template <typename Func>
+   void post_unique(std::string key, int priority, Func&& func,
+                    execution_priority_queue::on_duplicate dup = execution_priority_queue::on_duplicate::drop,
+                    bool raise_priority = true) {
+      post_to_context([this, key = std::move(key), priority, o = --order, tag = execution_priority_queue::current_tag(),
+                       f = std::forward<Func>(func), dup, raise_priority]() mutable {
+         pri_queue.add_unique(key, priority, o, tag, std::move(f), dup, raise_priority);
+      });
+   }
+
+   /**
+    * Post func attributed to `tag` rather than the tag of the handler currently executing on this thread.
+    * Used by fair queuing, see execution_priority_queue::enable_fair_queuing().
+    */
+   template <typename Func>
+   auto post(int priority, execution_priority_queue::queue_tag tag, Func&& func) {
+      if (auto* r = resource.load(std::memory_order_relaxed))
+         return boost::asio::post(io_ctx, pri_queue.wrap(priority, --order, tag, allocating_handler<std::decay_t<Func>>{std::forward<Func>(func), r}));
+      return boost::asio::post(io_ctx, pri_queue.wrap(priority, --order, tag, std::forward<Func>(func)));
+   }
+
+   /**
+    * Post func at the priority of the handler currently executing on this thread, see priority::inherit().
+    * When called from outside a queued handler, priority::medium is used.
+    */
+   template <typename Func>
+   auto post(Func&& func) {
+      return post(priority::inherit(), std::forward<Func>(func));
+   }
+
+   /**
+    * Wrap func for use as an asio completion handler (e.g. timer async_wait) so it runs through the priority queue.
+    */
+   template <typename Func>
+   auto wrap(int priority, Func&& func) {
+      return pri_queue.wrap(priority, --order, std::forward<Func>(func));
+   }
+
+   /**
+    * Wrap func to run at the priority of the handler currently executing on this thread, see priority::inherit().
+    */
+   template <typename Func>
+   auto wrap(Func&& func) {
+      return wrap(priority::inherit(), std::forward<Func>(func));
+   }
+
+   /**
+    * Barrier on the priority queue: completes once every handler posted with a priority >= min_priority before
+    * this call has executed. Handlers posted later or with a lower priority are not waited for.
+    *
+    * Example:
+    *   app().executor().quiesce(priority::medium, [](){ take_snapshot(); });
+    *   app().executor().quiesce(priority::high, boost::asio::use_future).wait(); // from a non-main thread
+    *
+    * @param token asio completion token with signature void(); a callback is invoked on the main thread
+    */
+   template <typename CompletionToken>
+   auto quiesce(int min_priority, CompletionToken&& token) {
+      return boost::asio::async_initiate<CompletionToken, void()>(
+         [this, min_priority](auto handler) {
+            const size_t o = --order;
+            boost::asio::post(io_ctx, pri_queue.wrap(min_priority, o, quiesce_marker<decltype(handler)>{*this, min_priority, o, std::move(handler)}));
+         },
+         token);
+   }
+
+   /**
+    * Safepoint shared by all appbase::thread_pool instances created with it; safepoint::run() pauses them
+    * between handlers at a consistent point.
+    */
+   safepoint& get_safepoint() {
+      return sp;
+   }
+
+   /**
+    * Quiescent state based reclamation domain of the main loop, which announces a quiescent state after each
+    * handler, and of the appbase::thread_pool instances created with it. See qsbr and rcu_ptr.
+    */
+   qsbr& get_qsbr() {
+      return domain;
+   }
+
    /**
     * Provide access to execution priority queue so it can be used to wrap functions for
     * prioritized execution.
@@ -26,7 +245,29 @@ public:
       return pri_queue;
    }
 
+   /**
+    * Allocate the storage of posted handlers, including the data copied by channel::publish(), from `r`: the asio
+    * operation carrying a handler to the main loop, allocated by the posting thread, and the handler once queued,
+    * see execution_priority_queue::set_memory_resource(). `r` must be thread safe when posting from other threads
+    * and outlive the executor. Handlers wrapped by wrap() for other asio operations are not covered.
+    */
+   void set_memory_resource(std::pmr::memory_resource* r) {
+      pri_queue.set_memory_resource(r);
+      resource.store(r, std::memory_order_relaxed);
+   }
+
    bool execute_highest() {
+      // a handler running the loop itself, e.g. through run_until(), may still hold references
+      if (depth)
+         return pri_queue.execute_highest();
+      ++depth;
+      struct leave {
+         default_executor& e;
+         ~leave() {
+            --e.depth;
+            e.main_participant.quiescent();
+         }
+      } l{*this};
       return pri_queue.execute_highest();
    }
 
@@ -43,9 +284,53 @@ public:
    }
 
 private:
+   // a handler whose associated allocator makes asio allocate the operation carrying it from `resource`
+   template <typename Handler>
+   struct allocating_handler {
+      using allocator_type = std::pmr::polymorphic_allocator<std::byte>;
+
+      Handler                    handler;
+      std::pmr::memory_resource* resource;
+
+      allocator_type get_allocator() const noexcept { return allocator_type(resource); }
+
+      void operator()() { handler(); }
+   };
+
+   template <typename Handler>
+   void post_to_context(Handler&& h) {
+      if (auto* r = resource.load(std::memory_order_relaxed))
+         boost::asio::post(io_ctx, allocating_handler<std::decay_t<Handler>>{std::forward<Handler>(h), r});
+      else
+         boost::asio::post(io_ctx, std::forward<Handler>(h));
+   }
+
+   template <typename Handler>
+   struct quiesce_marker {
+      default_executor& exec;
+      int               min_priority;
+      size_t            order;
+      Handler           handler;
+
+      void operator()() {
+         // fair queued levels do not run strictly in order, re-queue behind anything still pending from before
+         if (exec.pri_queue.pending_before(min_priority, order)) {
+            exec.pri_queue.add(min_priority, order, std::move(*this));
+            return;
+         }
+         std::move(handler)();
+      }
+   };
+
    // members are ordered taking into account that the last one is destructed first
    boost::asio::io_context  io_ctx;
+   appbase::qsbr            domain; // outlives queued handlers, which may retire objects when destroyed
    execution_priority_queue pri_queue;
+   appbase::safepoint       sp;
+   qsbr::participant        main_participant{domain};
+   std::list<std::function<void()>>::iterator qsbr_waker;
+   uint32_t                 depth = 0; // nesting of execute_highest()
+   std::atomic<std::pmr::memory_resource*> resource{nullptr}; // of posts, see set_memory_resource()
    std::size_t order = std::numeric_limits<size_t>::max(); // to maintain FIFO ordering in queue within priority
 };
 
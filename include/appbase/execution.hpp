@@ -0,0 +1,519 @@
+#pragma once
+
+#include <appbase/application_base.hpp>
+
+#include <atomic>
+#include <cassert>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <variant>
+
+namespace appbase::execution {
+
+/**
+ * Minimal sender/receiver layer modeled on P2300 (std::execution) for composing work on the application's
+ * priority queue without a heap allocation per step.
+ *
+ * - A *receiver* has member functions `set_value(Vs...)`, `set_error(std::exception_ptr)` and `set_stopped()`.
+ * - A *sender* declares `value_type` (`void` or the single type it completes with) and has
+ *   `connect(Receiver) &&` returning an *operation state* with `start()`. Operation states are neither copied
+ *   nor moved once started and are stored wherever the caller puts them (stack, coroutine frame, another
+ *   operation state); composing with then() / when_all() nests them without allocating.
+ *
+ * Example:
+ *   auto sched = appbase::execution::get_scheduler(app());
+ *   auto [a, b] = *sync_wait(when_all(sched.schedule(priority::high) | then([]() { return read_state(); }),
+ *                                     sched.schedule(priority::low)  | then([]() { return other(); })));
+ */
+
+template <typename Sender, typename Receiver>
+using connect_result_t = decltype(std::declval<Sender>().connect(std::declval<Receiver>()));
+
+template <typename Sender>
+using value_type_t = typename std::decay_t<Sender>::value_type;
+
+namespace detail {
+   // void is not a valid tuple element, used where the values of several senders are aggregated
+   template <typename T>
+   using non_void_t = std::conditional_t<std::is_void_v<T>, std::monostate, T>;
+
+   // constructs a non-movable operation state in place from a function returning it
+   template <typename F>
+   struct emplacer {
+      F f;
+      operator std::invoke_result_t<F>() && { return std::move(f)(); }
+   };
+   template <typename F>
+   emplacer(F) -> emplacer<F>;
+} // namespace detail
+
+// ------------------------------------------------------------------------------------------
+template <typename Executor, typename Receiver>
+class schedule_op {
+public:
+   schedule_op(Executor& exec, const application_base& app, int priority, Receiver r)
+      : exec_(exec), app_(app), priority_(priority), r_(std::move(r)) {}
+
+   schedule_op(const schedule_op&) = delete;
+   schedule_op& operator=(const schedule_op&) = delete;
+
+   void start() noexcept {
+      exec_.post(priority_, completion{this});
+   }
+
+private:
+   // completes the receiver when run by the main loop; if destroyed without running (queue cleared at shutdown)
+   // the receiver is completed with set_stopped() so nobody waits forever
+   struct completion {
+      explicit completion(schedule_op* op) : op(op) {}
+      completion(completion&& o) noexcept : op(std::exchange(o.op, nullptr)) {}
+      completion(const completion&) = delete;
+
+      ~completion() {
+         if (op)
+            op->r_.set_stopped();
+      }
+
+      void operator()() {
+         schedule_op* o = std::exchange(op, nullptr);
+         if (o->app_.is_quiting())
+            o->r_.set_stopped();
+         else
+            o->r_.set_value();
+      }
+
+      schedule_op* op;
+   };
+
+   Executor&               exec_;
+   const application_base& app_;
+   int                     priority_;
+   Receiver                r_;
+};
+
+template <typename Executor>
+class schedule_sender {
+public:
+   using value_type = void;
+
+   schedule_sender(Executor& exec, const application_base& app, int priority)
+      : exec_(&exec), app_(&app), priority_(priority) {}
+
+   template <typename Receiver>
+   schedule_op<Executor, std::decay_t<Receiver>> connect(Receiver&& r) && {
+      return {*exec_, *app_, priority_, std::forward<Receiver>(r)};
+   }
+
+private:
+   Executor*               exec_;
+   const application_base* app_;
+   int                     priority_;
+};
+
+/**
+ * Scheduler for the application main loop. Work started by its senders runs on the main thread at the given
+ * priority, and completes with set_stopped() instead of running once application_base::is_quiting().
+ */
+template <typename Executor>
+class scheduler {
+public:
+   scheduler(Executor& exec, const application_base& app) : exec_(&exec), app_(&app) {}
+
+   /// sender completing on the main thread at `priority`; by default the priority of the current handler
+   schedule_sender<Executor> schedule(int priority = priority::inherit()) const {
+      return {*exec_, *app_, priority};
+   }
+
+   bool operator==(const scheduler& o) const { return exec_ == o.exec_; }
+   bool operator!=(const scheduler& o) const { return exec_ != o.exec_; }
+
+private:
+   Executor*               exec_;
+   const application_base* app_;
+};
+
+/// scheduler of the application `a`, e.g. get_scheduler(app())
+template <typename Application>
+auto get_scheduler(Application& a) {
+   return scheduler<std::decay_t<decltype(a.executor())>>(a.executor(), a);
+}
+
+// ------------------------------------------------------------------------------------------
+template <typename F, typename Receiver>
+struct then_receiver {
+   F        f;
+   Receiver r;
+
+   template <typename... Vs>
+   void set_value(Vs&&... vs) {
+      using result_t = std::invoke_result_t<F, Vs...>;
+      if constexpr (std::is_void_v<result_t>) {
+         try {
+            std::invoke(std::move(f), std::forward<Vs>(vs)...);
+         } catch (...) {
+            r.set_error(std::current_exception());
+            return;
+         }
+         r.set_value();
+      } else {
+         std::optional<result_t> result;
+         try {
+            result.emplace(std::invoke(std::move(f), std::forward<Vs>(vs)...));
+         } catch (...) {
+            r.set_error(std::current_exception());
+            return;
+         }
+         r.set_value(std::move(*result));
+      }
+   }
+   void set_error(std::exception_ptr e) { r.set_error(std::move(e)); }
+   void set_stopped() { r.set_stopped(); }
+};
+
+template <typename Sender, typename F>
+class then_sender {
+   template <typename V, typename = void>
+   struct result { using type = std::invoke_result_t<F, V>; };
+   template <typename V>
+   struct result<V, std::enable_if_t<std::is_void_v<V>>> { using type = std::invoke_result_t<F>; };
+
+public:
+   using value_type = typename result<value_type_t<Sender>>::type;
+
+   then_sender(Sender s, F f) : s_(std::move(s)), f_(std::move(f)) {}
+
+   template <typename Receiver>
+   auto connect(Receiver&& r) && {
+      return std::move(s_).connect(then_receiver<F, std::decay_t<Receiver>>{std::move(f_), std::forward<Receiver>(r)});
+   }
+
+private:
+   Sender s_;
+   F      f_;
+};
+
+/// sender which invokes `f` with the value of `s`, completing with the result of `f`; exceptions become set_error
+template <typename Sender, typename F>
+then_sender<std::decay_t<Sender>, std::decay_t<F>> then(Sender&& s, F&& f) {
+   return {std::forward<Sender>(s), std::forward<F>(f)};
+}
+
+template <typename F>
+struct then_closure {
+   F f;
+};
+
+/// pipeable form: `sched.schedule(p) | then(f)`
+template <typename F>
+then_closure<std::decay_t<F>> then(F&& f) {
+   return {std::forward<F>(f)};
+}
+
+template <typename Sender, typename F>
+auto operator|(Sender&& s, then_closure<F> c) -> then_sender<std::decay_t<Sender>, F> {
+   return {std::forward<Sender>(s), std::move(c.f)};
+}
+
+// ------------------------------------------------------------------------------------------
+/**
+ * Completion passed to the function given to from_callback(). Exactly one of its members must be called, from
+ * any thread; the receiver is completed on that thread.
+ */
+template <typename Receiver>
+class callback_completion {
+public:
+   explicit callback_completion(Receiver& r) : r_(&r) {}
+
+   void operator()() const { r_->set_value(); }
+   void set_error(std::exception_ptr e) const { r_->set_error(std::move(e)); }
+   void set_stopped() const { r_->set_stopped(); }
+
+private:
+   Receiver* r_;
+};
+
+template <typename F, typename Receiver>
+class callback_op {
+public:
+   callback_op(F&& f, Receiver&& r) : f_(std::move(f)), r_(std::move(r)) {}
+
+   callback_op(const callback_op&) = delete;
+   callback_op& operator=(const callback_op&) = delete;
+
+   void start() noexcept {
+      try {
+         std::move(f_)(callback_completion<Receiver>(r_));
+      } catch (...) {
+         r_.set_error(std::current_exception());
+      }
+   }
+
+private:
+   F        f_;
+   Receiver r_;
+};
+
+template <typename F>
+class callback_sender {
+public:
+   using value_type = void;
+
+   explicit callback_sender(F f) : f_(std::move(f)) {}
+
+   template <typename Receiver>
+   callback_op<F, std::decay_t<Receiver>> connect(Receiver&& r) && {
+      return {std::move(f_), std::decay_t<Receiver>(std::forward<Receiver>(r))};
+   }
+
+private:
+   F f_;
+};
+
+/**
+ * Sender adapting callback based asynchronous work: when started, `f` is invoked with a callback_completion to
+ * call once the work is done. If `f` throws before handing off the completion, the sender completes with that error.
+ *
+ * Example:
+ *   from_callback([this](auto done) {
+ *      socket.async_connect(ep, [done](const boost::system::error_code& ec) {
+ *         if (ec) done.set_error(std::make_exception_ptr(boost::system::system_error(ec))); else done();
+ *      });
+ *   })
+ */
+template <typename F>
+callback_sender<std::decay_t<F>> from_callback(F&& f) {
+   return callback_sender<std::decay_t<F>>(std::forward<F>(f));
+}
+
+// ------------------------------------------------------------------------------------------
+template <typename Receiver, typename... Senders>
+class when_all_op {
+   template <size_t I>
+   struct child_receiver {
+      when_all_op* op;
+
+      template <typename... Vs>
+      void set_value(Vs&&... vs) {
+         if constexpr (sizeof...(Vs) == 0)
+            std::get<I>(op->values_).emplace();
+         else
+            std::get<I>(op->values_).emplace(std::forward<Vs>(vs)...);
+         op->arrive();
+      }
+      void set_error(std::exception_ptr e) {
+         {
+            std::lock_guard<std::mutex> g(op->mtx_);
+            if (!op->error_)
+               op->error_ = std::move(e);
+         }
+         op->arrive();
+      }
+      void set_stopped() {
+         op->stopped_.store(true, std::memory_order_relaxed);
+         op->arrive();
+      }
+   };
+
+   template <typename Seq>
+   struct ops;
+   template <size_t... I>
+   struct ops<std::index_sequence<I...>> {
+      using type = std::tuple<connect_result_t<Senders, child_receiver<I>>...>;
+   };
+   using ops_t = typename ops<std::index_sequence_for<Senders...>>::type;
+
+   template <size_t... I>
+   ops_t connect_all(std::tuple<Senders...>& senders, std::index_sequence<I...>) {
+      return ops_t(detail::emplacer{[&]() { return std::move(std::get<I>(senders)).connect(child_receiver<I>{this}); }}...);
+   }
+
+   // the last child to complete completes the receiver; no member is touched afterwards
+   void arrive() {
+      if (remaining_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+         complete(std::index_sequence_for<Senders...>{});
+   }
+
+   template <size_t... I>
+   void complete(std::index_sequence<I...>) {
+      if (error_)
+         r_.set_error(std::move(error_));
+      else if (stopped_.load(std::memory_order_relaxed))
+         r_.set_stopped();
+      else
+         r_.set_value(std::tuple<detail::non_void_t<value_type_t<Senders>>...>(std::move(*std::get<I>(values_))...));
+   }
+
+public:
+   when_all_op(Receiver r, std::tuple<Senders...>&& senders)
+      : r_(std::move(r)), ops_(connect_all(senders, std::index_sequence_for<Senders...>{})) {}
+
+   when_all_op(const when_all_op&) = delete;
+   when_all_op& operator=(const when_all_op&) = delete;
+
+   void start() noexcept {
+      std::apply([](auto&... op) { (op.start(), ...); }, ops_);
+   }
+
+private:
+   Receiver                                                                    r_;
+   std::tuple<std::optional<detail::non_void_t<value_type_t<Senders>>>...>     values_;
+   std::atomic<size_t>                                                         remaining_{sizeof...(Senders)};
+   std::atomic<bool>                                                           stopped_{false};
+   std::mutex                                                                  mtx_;
+   std::exception_ptr                                                          error_;
+   ops_t                                                                       ops_;
+};
+
+template <typename... Senders>
+class when_all_sender {
+public:
+   using value_type = std::tuple<detail::non_void_t<value_type_t<Senders>>...>;
+
+   explicit when_all_sender(Senders... s) : senders_(std::move(s)...) {}
+
+   template <typename Receiver>
+   when_all_op<std::decay_t<Receiver>, Senders...> connect(Receiver&& r) && {
+      return {std::forward<Receiver>(r), std::move(senders_)};
+   }
+
+private:
+   std::tuple<Senders...> senders_;
+};
+
+/**
+ * Sender completing once all `senders` have completed, with a tuple of their values (std::monostate for void
+ * senders). If any completes with an error the first error is forwarded, otherwise if any is stopped so is the
+ * aggregate. Children scheduled on the main loop run concurrently in priority order.
+ */
+template <typename... Senders>
+when_all_sender<std::decay_t<Senders>...> when_all(Senders&&... senders) {
+   static_assert(sizeof...(Senders) > 0, "when_all requires at least one sender");
+   return when_all_sender<std::decay_t<Senders>...>(std::forward<Senders>(senders)...);
+}
+
+// ------------------------------------------------------------------------------------------
+namespace detail {
+   template <typename T>
+   struct sync_wait_state {
+      std::mutex              mtx;
+      std::condition_variable cv;
+      bool                    done = false;
+      std::optional<T>        value;
+      std::exception_ptr      error;
+   };
+
+   template <typename T>
+   struct sync_wait_receiver {
+      sync_wait_state<T>* st;
+
+      template <typename... Vs>
+      void set_value(Vs&&... vs) {
+         std::lock_guard<std::mutex> g(st->mtx);
+         st->value.emplace(std::forward<Vs>(vs)...);
+         st->done = true;
+         st->cv.notify_one(); // under the lock: the waiter may destroy the state as soon as it is released
+      }
+      void set_error(std::exception_ptr e) {
+         std::lock_guard<std::mutex> g(st->mtx);
+         st->error = std::move(e);
+         st->done = true;
+         st->cv.notify_one();
+      }
+      void set_stopped() {
+         std::lock_guard<std::mutex> g(st->mtx);
+         st->done = true;
+         st->cv.notify_one();
+      }
+   };
+
+   template <typename Sender, typename Callback>
+   struct detached_op;
+
+   template <typename Sender, typename Callback>
+   struct detached_receiver {
+      detached_op<Sender, Callback>* op;
+
+      void finish(std::exception_ptr e);
+
+      template <typename... Vs>
+      void set_value(Vs&&...) { finish(nullptr); }
+      void set_error(std::exception_ptr e) { finish(std::move(e)); }
+      void set_stopped() { finish(nullptr); }
+   };
+
+   template <typename Sender, typename Callback>
+   struct detached_op {
+      detached_op(Sender&& s, Callback&& cb)
+         : cb(std::move(cb)), op(std::move(s).connect(detached_receiver<Sender, Callback>{this})) {}
+
+      Callback                                                       cb;
+      connect_result_t<Sender, detached_receiver<Sender, Callback>> op;
+   };
+
+   // the operation state is freed before the callback runs
+   template <typename Sender, typename Callback>
+   void detached_receiver<Sender, Callback>::finish(std::exception_ptr e) {
+      Callback cb = std::move(op->cb);
+      delete op;
+      cb(std::move(e));
+   }
+
+   struct rethrow_error {
+      void operator()(std::exception_ptr e) const {
+         if (e)
+            std::rethrow_exception(e); // handled like any exception escaping a main loop handler
+      }
+   };
+} // namespace detail
+
+/**
+ * Start `sender` and block the calling thread until it completes.
+ * Must not be called from the main thread while it runs the main loop, which would deadlock.
+ *
+ * @return the value of the sender (std::monostate for void senders), or std::nullopt if it was stopped
+ * @throws the exception the sender completed with
+ */
+template <typename Sender>
+std::optional<detail::non_void_t<value_type_t<Sender>>> sync_wait(Sender&& sender) {
+   using value_t = detail::non_void_t<value_type_t<Sender>>;
+   assert(!execution_priority_queue::executing());
+
+   detail::sync_wait_state<value_t> st;
+   auto op = std::move(sender).connect(detail::sync_wait_receiver<value_t>{&st});
+   op.start();
+
+   std::unique_lock<std::mutex> lk(st.mtx);
+   st.cv.wait(lk, [&]() { return st.done; });
+   if (st.error)
+      std::rethrow_exception(st.error);
+   return std::move(st.value);
+}
+
+/**
+ * Start `sender` without waiting for it; its operation state is allocated and freed on completion.
+ * `on_complete(std::exception_ptr)` is then invoked with the error the sender completed with, or nullptr when it
+ * completed with a value or was stopped.
+ */
+template <typename Sender, typename Callback>
+void start_detached(Sender&& sender, Callback&& on_complete) {
+   using op_t = detail::detached_op<std::decay_t<Sender>, std::decay_t<Callback>>;
+   auto* op = new op_t(std::decay_t<Sender>(std::forward<Sender>(sender)), std::decay_t<Callback>(std::forward<Callback>(on_complete)));
+   op->op.start();
+}
+
+/**
+ * Start `sender` without waiting for it. An error completion is rethrown where it happens, for a main loop
+ * handler the same as any handler exception.
+ */
+template <typename Sender>
+void start_detached(Sender&& sender) {
+   start_detached(std::forward<Sender>(sender), detail::rethrow_error{});
+}
+
+} // namespace appbase::execution
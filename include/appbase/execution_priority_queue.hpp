@@ -1,57 +1,450 @@
 #pragma once
+#include <appbase/memory_residency.hpp>
 #include <boost/asio.hpp>
 
-#include <queue>
+#include <algorithm>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <memory_resource>
+#include <optional>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <typeinfo>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
 
 namespace appbase {
 // adapted from: https://www.boost.org/doc/libs/1_69_0/doc/html/boost_asio/example/cpp11/invocation/prioritised_handlers.cpp
 
 class execution_priority_queue : public boost::asio::execution_context
 {
+   class queued_handler_base;
+
 public:
+   /// Identifies the origin of queued handlers (e.g. a plugin) for weighted fair queuing within a priority level
+   using queue_tag = uint32_t;
+   static constexpr queue_tag default_tag = 0;
 
    template <typename Function>
    void add(int priority, size_t order, Function function)
    {
-      std::unique_ptr<queued_handler_base> handler(new queued_handler<Function>(priority, order, std::move(function)));
+      add(priority, order, current_tag(), std::move(function));
+   }
+
+   template <typename Function>
+   void add(int priority, size_t order, queue_tag tag, Function function)
+   {
+      handler_ptr handler = make_handler<Function>(priority, order, std::move(function));
+      handler->set_tag(tag, virtual_start(priority, tag));
+
+      push(std::move(handler));
+   }
+
+   /**
+    * Tracks a handler added with add_tracked() so its priority can be changed, or the handler cancelled, while it
+    * is queued. Only accessed from the thread running the queue.
+    */
+   class task
+   {
+   public:
+      explicit task(int priority) : priority_(priority) {}
+
+      /// true while the handler is queued: not yet started, cancelled or cleared
+      bool pending() const { return handler_ != nullptr; }
+      int priority() const { return priority_; }
+
+   private:
+      friend class execution_priority_queue;
+      int                  priority_;
+      bool                 cancelled_ = false;
+      queued_handler_base* handler_ = nullptr;
+   };
+
+   /**
+    * Add `function` tracked by `t`. The priority is taken from `t`, which may have been changed by set_priority()
+    * before the handler reached the queue. Nothing is added if `t` has been cancelled.
+    */
+   template <typename Function>
+   void add_tracked(size_t order, queue_tag tag, Function function, const std::shared_ptr<task>& t)
+   {
+      if (t->cancelled_)
+         return;
+      handler_ptr handler = make_handler<Function>(t->priority_, order, std::move(function));
+      handler->set_tag(tag, virtual_start(t->priority_, tag));
+      handler->task_ = t;
+      t->handler_ = handler.get();
+      push(std::move(handler));
+   }
+
+   /**
+    * Raise or lower the priority of the handler tracked by `t` in O(log n).
+    * @return true if the handler is still queued; otherwise only the priority recorded in `t` is updated
+    */
+   bool set_priority(task& t, int priority)
+   {
+      t.priority_ = priority;
+      queued_handler_base* h = t.handler_;
+      if (!h)
+         return false;
+      if (h->held_) {
+         h->priority_ = priority; // fair queued once released
+      } else if (h->priority_ != priority) {
+         h->priority_ = priority;
+         h->set_tag(h->tag(), virtual_start(priority, h->tag()));
+         sift_down(sift_up(h->heap_index_));
+      }
+      return true;
+   }
+
+   /**
+    * Remove the handler tracked by `t` from the queue without executing it, or prevent it from being added.
+    * @return true if the handler was queued
+    */
+   bool cancel(task& t)
+   {
+      t.cancelled_ = true;
+      if (!t.handler_)
+         return false;
+      if (t.handler_->held_)
+         remove_held(t.handler_->heap_index_);
+      else
+         remove(t.handler_->heap_index_);
+      return true;
+   }
+
+   /// bound on nested inline execution by dispatch() so completion chains cannot grow the stack unbounded
+   static constexpr uint32_t max_inline_depth = 8;
+
+   /**
+    * @return true if a handler at `priority` may run immediately instead of being queued: the caller is a handler
+    * of this queue running at an equal or higher priority, nothing of higher priority is queued and fewer than
+    * max_inline_depth handlers are already nested inline.
+    */
+   bool can_run_inline(int priority) const
+   {
+      return running_in_this_thread() && current_handler_->priority() >= priority && inline_depth_ < max_inline_depth &&
+             (handlers_.empty() || handlers_.front()->priority() <= priority);
+   }
+
+   /**
+    * Run `function` immediately if can_run_inline(priority), otherwise add it to the queue. Run inline, it is the
+    * current handler, at `priority` and under `tag`, for the work it posts or dispatches and for the profiler.
+    */
+   template <typename Function>
+   void dispatch(int priority, size_t order, queue_tag tag, Function function)
+   {
+      if (can_run_inline(priority)) {
+         struct depth_guard {
+            depth_guard() { ++inline_depth_; }
+            ~depth_guard() { --inline_depth_; }
+         } depth;
+         inline_handler<Function> h(priority, order, tag, function);
+         scoped_current_handler g(*this, h);
+         h.execute();
+      } else {
+         add(priority, order, tag, std::move(function));
+      }
+   }
+
+   /// what add_unique() does when a handler with the same key is already queued
+   enum class on_duplicate {
+      drop,    ///< keep the queued handler, drop the new one
+      replace  ///< keep the queued handler's place in the queue but run the new function instead
+   };
+
+   /**
+    * Add `function` unless a handler added with the same `key` is still queued (not yet started executing).
+    *
+    * @param dup whether the new function is dropped or replaces the payload of the queued handler
+    * @param raise_priority if true and `priority` is higher than the queued handler's, the queued handler is moved
+    *                       up to `priority`
+    * @return true if `function` was queued as a new handler
+    */
+   template <typename Function>
+   bool add_unique(std::string_view key, int priority, size_t order, queue_tag tag, Function function,
+                   on_duplicate dup, bool raise_priority)
+   {
+      auto itr = unique_.find(key);
+      if (itr == unique_.end()) {
+         handler_ptr handler = make_handler<Function>(priority, order, std::move(function));
+         handler->set_tag(tag, virtual_start(priority, tag));
+         handler->unique_ = unique_.emplace(std::string(key), handler.get()).first;
+         push(std::move(handler));
+         return true;
+      }
+
+      queued_handler_base* queued = itr->second;
+      if (dup == on_duplicate::replace) {
+         handler_ptr handler = make_handler<Function>(queued->priority(), queued->order(), std::move(function));
+         handler->set_tag(queued->tag(), queued->virtual_start());
+         handler->unique_ = itr;
+         handler->heap_index_ = queued->heap_index_;
+         handler->task_ = std::move(queued->task_);
+         if (handler->task_)
+            handler->task_->handler_ = handler.get();
+         handler->held_ = queued->held_;
+         itr->second = handler.get();
+         queued = handler.get();
+         (queued->held_ ? held_ : handlers_)[queued->heap_index_] = std::move(handler);
+      }
+      if (raise_priority && priority > queued->priority()) {
+         queued->priority_ = priority;
+         if (!queued->held_) {
+            queued->set_tag(queued->tag(), virtual_start(priority, queued->tag()));
+            sift_up(queued->heap_index_);
+         }
+      }
+      return false;
+   }
+
+   /**
+    * Add all `functions` at `priority` with orders first_order, first_order - 1, ... so that they run in sequence,
+    * reserving queue capacity once.
+    */
+   template <typename Function>
+   void add_bulk(int priority, size_t first_order, queue_tag tag, std::vector<Function>&& functions)
+   {
+      handlers_.reserve(handlers_.size() + functions.size());
+      for (auto& f : functions) {
+         handler_ptr handler = make_handler<Function>(priority, first_order--, std::move(f));
+         handler->set_tag(tag, virtual_start(priority, tag));
+         push(std::move(handler));
+      }
+   }
+
+   /**
+    * Register (or look up) a tag by name, e.g. a plugin name. Tags of the handler being executed are inherited
+    * by handlers it adds, so a plugin's async chains stay attributed to the plugin.
+    */
+   queue_tag register_tag(std::string_view name)
+   {
+      auto itr = tag_ids_.find(std::string(name));
+      if (itr != tag_ids_.end())
+         return itr->second;
+      queue_tag tag = static_cast<queue_tag>(tag_names_.size());
+      tag_names_.emplace_back(name);
+      tag_weights_.push_back(1);
+      tag_ids_.emplace(tag_names_.back(), tag);
+      return tag;
+   }
+
+   const std::string& tag_name(queue_tag tag) const { return tag_names_.at(tag); }
+
+   /// number of registered tags, including default_tag
+   size_t tag_count() const { return tag_names_.size(); }
+
+   /**
+    * Set the share of a fair queued priority level given to handlers of `tag` relative to other tags.
+    * Default weight is 1.
+    */
+   void set_tag_weight(queue_tag tag, uint32_t weight)
+   {
+      tag_weights_.at(tag) = std::max<uint32_t>(weight, 1);
+   }
 
-      handlers_.push(std::move(handler));
+   /**
+    * Subdivide `priority` into per-tag sub-queues served in proportion to their weights, so one tag flooding
+    * the level cannot starve the others. Within a tag handlers stay FIFO. Other priority levels are unaffected.
+    * Should be configured before handlers are queued at that priority.
+    */
+   void enable_fair_queuing(int priority)
+   {
+      fair_levels_.try_emplace(priority);
+   }
+
+   /**
+    * Tag of the handler currently being executed on this thread, or the tag set by a scoped_tag.
+    */
+   static queue_tag current_tag() { return current_tag_; }
+
+   /**
+    * Attribute handlers added on this thread during the lifetime of this object to `tag`.
+    */
+   class scoped_tag
+   {
+   public:
+      explicit scoped_tag(queue_tag tag) : prev_(current_tag_) { current_tag_ = tag; }
+      ~scoped_tag() { current_tag_ = prev_; }
+
+      scoped_tag(const scoped_tag&) = delete;
+      scoped_tag& operator=(const scoped_tag&) = delete;
+
+   private:
+      queue_tag prev_;
+   };
+
+   /**
+    * Wrap `f` to run under the tag current on this thread now, e.g. so that a channel subscriber or method provider
+    * registered by a plugin runs attributed to that plugin rather than to the publisher or caller. When bound under
+    * the default tag `f` runs under the tag of its caller.
+    */
+   template <typename F>
+   static auto bind_current_tag(F f)
+   {
+      return [tag = current_tag_, f = std::move(f)](auto&&... args) mutable -> decltype(auto) {
+         scoped_tag t(tag != default_tag ? tag : current_tag_);
+         return f(std::forward<decltype(args)>(args)...);
+      };
    }
 
    void clear()
    {
-      handlers_ = prio_queue();
+      handlers_.clear();
+      held_.clear();
+      held_tags_.clear();
+      unique_.clear();
+      for (auto& level : fair_levels_)
+         level.second = fair_level{};
    }
    
    void execute_all()
    {
       while (!handlers_.empty()) {
-         handlers_.top()->execute();
-         handlers_.pop();
+         execute(pop());
       }
    }
 
    bool execute_highest()
    {
       if( !handlers_.empty() ) {
-         handlers_.top()->execute();
-         handlers_.pop();
+         execute(pop());
       }
 
       return !handlers_.empty();
    }
 
+   /**
+    * @return true if a handler with priority >= min_priority that was added with an order greater than
+    * `order` (i.e. before it, see default_executor::post) is still queued
+    */
+   bool pending_before(int min_priority, size_t order) const
+   {
+      return std::any_of(handlers_.begin(), handlers_.end(), [&](const auto& h) {
+         return h->priority() >= min_priority && h->order() > order;
+      });
+   }
+
+   /**
+    * Allocate handler storage from `resource`, which must outlive the queue: the slabs handlers are pooled in and
+    * handlers too large to pool. By default (nullptr) slabs are memory_residency regions and large handlers come
+    * from the global heap. Storage already allocated is returned to where it came from.
+    * Must be called from the thread running the queue.
+    */
+   void set_memory_resource(std::pmr::memory_resource* resource)
+   {
+      pool_.set_resource(resource);
+   }
+
+   std::pmr::memory_resource* get_memory_resource() const
+   {
+      return pool_.resource();
+   }
+
+   /**
+    * Allocate and fault in `slabs` slabs of handler storage per size class ahead of use, e.g. before startup.
+    * Must be called from the thread running the queue.
+    * @return bytes added to the handler pool
+    */
+   size_t prefault_handlers(size_t slabs)
+   {
+      return pool_.prefault(slabs);
+   }
+
+   /**
+    * @return number of queued handlers attributed to `tag`
+    */
+   size_t pending(queue_tag tag) const
+   {
+      return std::count_if(handlers_.begin(), handlers_.end(), [&](const auto& h) { return h->tag() == tag; });
+   }
+
+   /**
+    * Hold back handlers added under `tag` from now on: they stay queued (and can be cancelled, replaced or
+    * reprioritized) but do not run, nor count in pending(), size() or empty(), until release(tag), so that the
+    * handlers of `tag` already queued drain even if they keep adding more. Holds nest.
+    */
+   void hold(queue_tag tag)
+   {
+      if (held_tags_.size() <= tag)
+         held_tags_.resize(tag + 1, 0);
+      ++held_tags_[tag];
+   }
+
+   /**
+    * Undo one hold(tag); once no hold is left the handlers held back are queued in the order they were added.
+    */
+   void release(queue_tag tag)
+   {
+      if (tag >= held_tags_.size() || held_tags_[tag] == 0 || --held_tags_[tag] > 0)
+         return;
+      auto first = std::stable_partition(held_.begin(), held_.end(), [&](const auto& h) { return h->tag() != tag; });
+      std::vector<handler_ptr> released(std::make_move_iterator(first), std::make_move_iterator(held_.end()));
+      held_.erase(first, held_.end());
+      for (size_t i = 0; i < held_.size(); ++i)
+         held_[i]->heap_index_ = i;
+      for (auto& h : released) {
+         h->held_ = false;
+         h->set_tag(tag, virtual_start(h->priority(), tag));
+         push(std::move(h));
+      }
+   }
+
+   /**
+    * Undo all holds, see hold()
+    */
+   void release_all()
+   {
+      for (queue_tag tag = 0; tag < held_tags_.size(); ++tag) {
+         if (held_tags_[tag] > 0) {
+            held_tags_[tag] = 1;
+            release(tag);
+         }
+      }
+   }
+
+   /**
+    * @return true if called from within a handler executed by an execution_priority_queue on this thread
+    */
+   static bool executing() { return current_handler_ != nullptr; }
+
+   /**
+    * Mangled type name of the function of the handler being executed on this thread, nullptr outside of handlers.
+    * Async-signal-safe, the profiler attributes samples with it.
+    */
+   static const char* current_handler_label() { return current_handler_ ? current_handler_->label() : nullptr; }
+
+   /**
+    * @return true if called from within a handler executed by this queue on this thread
+    */
+   bool running_in_this_thread() const { return current_queue_ == this; }
+
+   /**
+    * Priority of the handler currently being executed on this thread.
+    * @param fallback returned when not called from within a handler executed by an execution_priority_queue
+    */
+   static int current_priority(int fallback) {
+      return current_handler_ ? current_handler_->priority() : fallback;
+   }
+
    size_t size() const { return handlers_.size(); }
 
    bool empty() const { return handlers_.empty(); }
 
-   const auto& top() const { return handlers_.top(); }
+   const auto& top() const { return handlers_.front(); }
 
    class executor
    {
    public:
       executor(execution_priority_queue& q, int p, size_t o)
-            : context_(q), priority_(p), order_(o)
+            : context_(q), priority_(p), order_(o), tag_(current_tag())
+      {
+      }
+
+      executor(execution_priority_queue& q, int p, size_t o, queue_tag t)
+            : context_(q), priority_(p), order_(o), tag_(t)
       {
       }
 
@@ -60,22 +453,24 @@ public:
          return context_;
       }
 
+      // runs f immediately when called from a handler of this queue at an equal or higher priority with nothing
+      // higher queued, see can_run_inline(); otherwise queues it like post()
       template <typename Function, typename Allocator>
       void dispatch(Function f, const Allocator&) const
       {
-         context_.add(priority_, order_, std::move(f));
+         context_.dispatch(priority_, order_, tag_, std::move(f));
       }
 
       template <typename Function, typename Allocator>
       void post(Function f, const Allocator&) const
       {
-         context_.add(priority_, order_, std::move(f));
+         context_.add(priority_, order_, tag_, std::move(f));
       }
 
       template <typename Function, typename Allocator>
       void defer(Function f, const Allocator&) const
       {
-         context_.add(priority_, order_, std::move(f));
+         context_.add(priority_, order_, tag_, std::move(f));
       }
 
       void on_work_started() const noexcept {}
@@ -83,7 +478,7 @@ public:
 
       bool operator==(const executor& other) const noexcept
       {
-         return order_ == other.order_ && &context_ == &other.context_ && priority_ == other.priority_;
+         return order_ == other.order_ && &context_ == &other.context_ && priority_ == other.priority_ && tag_ == other.tag_;
       }
 
       bool operator!=(const executor& other) const noexcept
@@ -95,6 +490,7 @@ public:
       execution_priority_queue& context_;
       int priority_;
       size_t order_;
+      queue_tag tag_;
    };
 
    template <typename Function>
@@ -104,7 +500,137 @@ public:
       return boost::asio::bind_executor( executor(*this, priority, order), std::forward<Function>(func) );
    }
 
+   template <typename Function>
+   boost::asio::executor_binder<Function, executor>
+   wrap(int priority, size_t order, queue_tag tag, Function&& func)
+   {
+      return boost::asio::bind_executor( executor(*this, priority, order, tag), std::forward<Function>(func) );
+   }
+
 private:
+   // recycles handler storage in size classes so queuing a handler does not hit the global heap in steady state;
+   // only used from the thread running the queue
+   class handler_pool
+   {
+   public:
+      static constexpr size_t granularity = 64;
+      static constexpr size_t num_classes = 8;         // pools handlers up to 512 bytes
+      static constexpr size_t slab_size   = 64 * 1024;
+
+      handler_pool() = default;
+      handler_pool(const handler_pool&) = delete;
+      handler_pool& operator=(const handler_pool&) = delete;
+
+      ~handler_pool()
+      {
+         for (const auto& slab : slabs_) {
+            if (slab.resource)
+               slab.resource->deallocate(slab.p, slab.size, alignof(std::max_align_t));
+            else
+               memory_residency::deallocate_region(slab.p, slab.size);
+         }
+      }
+
+      /// resource new slabs are allocated from, nullptr for memory_residency regions
+      void set_resource(std::pmr::memory_resource* r) { resource_ = r; }
+      std::pmr::memory_resource* resource() const { return resource_; }
+
+      static bool pooled(size_t size) { return size <= granularity * num_classes; }
+
+      void* allocate(size_t size)
+      {
+         free_block*& head = free_[size_class(size)];
+         if (!head)
+            refill(size_class(size));
+         free_block* b = head;
+         head = b->next;
+         return b;
+      }
+
+      void deallocate(void* p, size_t size) noexcept
+      {
+         free_block*& head = free_[size_class(size)];
+         head = ::new (p) free_block{head};
+      }
+
+      /// add `slabs` slabs to each size class, faulting in their pages; @return the bytes added
+      size_t prefault(size_t slabs)
+      {
+         size_t bytes = 0;
+         for (size_t cls = 0; cls < num_classes; ++cls)
+            for (size_t i = 0; i < slabs; ++i)
+               bytes += refill(cls);
+         return bytes;
+      }
+
+   private:
+      struct free_block { free_block* next; };
+
+      static size_t size_class(size_t size) { return (size + granularity - 1) / granularity - 1; }
+
+      // threading the new blocks onto the free list writes to, and so faults in, every page of the slab
+      size_t refill(size_t cls)
+      {
+         const size_t block = (cls + 1) * granularity;
+         const size_t bytes = resource_ ? slab_size : memory_residency::region_size(slab_size);
+         const size_t count = bytes / block;
+         char* slab = static_cast<char*>(resource_ ? resource_->allocate(bytes, alignof(std::max_align_t))
+                                                   : memory_residency::allocate_region(bytes));
+         slabs_.push_back({slab, bytes, resource_});
+         for (size_t i = 0; i < count; ++i)
+            deallocate(slab + i * block, block);
+         return bytes;
+      }
+
+      struct slab { void* p; size_t size; std::pmr::memory_resource* resource; };
+
+      free_block*                free_[num_classes] = {};
+      std::vector<slab>          slabs_;
+      std::pmr::memory_resource* resource_ = nullptr;
+   };
+
+   struct handler_deleter
+   {
+      handler_pool* pool = nullptr;
+      void operator()(queued_handler_base* h) const noexcept;
+   };
+   using handler_ptr = std::unique_ptr<queued_handler_base, handler_deleter>;
+
+   template <typename Function>
+   handler_ptr make_handler(int priority, size_t order, Function&& function)
+   {
+      using handler_t = queued_handler<std::decay_t<Function>>;
+      if constexpr (alignof(handler_t) <= alignof(std::max_align_t)) {
+         if (handler_pool::pooled(sizeof(handler_t))) {
+            void* mem = pool_.allocate(sizeof(handler_t));
+            try {
+               handler_ptr h(::new (mem) handler_t(priority, order, std::forward<Function>(function)), handler_deleter{&pool_});
+               h->alloc_size_ = sizeof(handler_t);
+               return h;
+            } catch (...) {
+               pool_.deallocate(mem, sizeof(handler_t));
+               throw;
+            }
+         }
+         if (std::pmr::memory_resource* r = pool_.resource()) {
+            void* mem = r->allocate(sizeof(handler_t), alignof(std::max_align_t));
+            try {
+               handler_ptr h(::new (mem) handler_t(priority, order, std::forward<Function>(function)), handler_deleter{&pool_});
+               h->alloc_size_ = sizeof(handler_t);
+               h->resource_ = r;
+               return h;
+            } catch (...) {
+               r->deallocate(mem, sizeof(handler_t), alignof(std::max_align_t));
+               throw;
+            }
+         }
+      }
+      return handler_ptr(new handler_t(priority, order, std::forward<Function>(function)), handler_deleter{&pool_});
+   }
+
+   // keyed handlers currently queued, see add_unique()
+   using unique_map = std::map<std::string, queued_handler_base*, std::less<>>;
+
    class queued_handler_base
    {
    public:
@@ -114,23 +640,48 @@ private:
       {
       }
 
-      virtual ~queued_handler_base() = default;
+      virtual ~queued_handler_base()
+      {
+         if (task_)
+            task_->handler_ = nullptr;
+      }
 
       virtual void execute() = 0;
 
+      /// mangled type name of the handler's function
+      virtual const char* label() const = 0;
+
       int priority() const { return priority_; }
-      // C++20
-      // friend std::weak_ordering operator<=>(const queued_handler_base&,
-      //                                       const queued_handler_base&) noexcept = default;
+      size_t order() const { return order_; }
+      queue_tag tag() const { return tag_; }
+      uint64_t virtual_start() const { return vstart_; }
+
+      void set_tag(queue_tag tag, uint64_t vstart)
+      {
+         tag_ = tag;
+         vstart_ = vstart;
+      }
+
+      // within a priority, the smaller virtual start runs first; it is always 0 outside of fair queued levels
       friend bool operator<(const queued_handler_base& a,
                             const queued_handler_base& b) noexcept
       {
-         return std::tie( a.priority_, a.order_ ) < std::tie( b.priority_, b.order_ );
+         return std::tie( a.priority_, b.vstart_, a.order_ ) < std::tie( b.priority_, a.vstart_, b.order_ );
       }
 
    private:
+      friend class execution_priority_queue;
+
       int priority_;
       size_t order_;
+      queue_tag tag_ = default_tag;
+      uint64_t vstart_ = 0;
+      size_t heap_index_ = 0; // index in held_ while held_
+      bool held_ = false;
+      size_t alloc_size_ = 0; // size allocated from handler_pool or resource_, 0 if allocated with new
+      std::pmr::memory_resource* resource_ = nullptr; // resource of a handler too large for handler_pool
+      std::optional<unique_map::iterator> unique_;
+      std::shared_ptr<task> task_;
    };
 
    template <typename Function>
@@ -148,21 +699,213 @@ private:
          function_();
       }
 
+      const char* label() const override
+      {
+         return typeid(Function).name();
+      }
+
    private:
       Function function_;
    };
 
-   struct deref_less
+   // a function run inline by dispatch(), current while it runs so that it sees its own priority, tag and label
+   template <typename Function>
+   class inline_handler final : public queued_handler_base
    {
-      template<typename Pointer>
-      bool operator()(const Pointer& a, const Pointer& b) noexcept(noexcept(*a < *b))
+   public:
+      inline_handler(int p, size_t order, queue_tag tag, Function& f)
+            : queued_handler_base( p, order )
+            , function_( f )
+      {
+         set_tag(tag, 0);
+      }
+
+      void execute() override
+      {
+         function_();
+      }
+
+      const char* label() const override
       {
-         return *a < *b;
+         return typeid(Function).name();
+      }
+
+   private:
+      Function& function_;
+   };
+
+   // tracks the handler being executed on this thread so nested posts can inherit its priority and tag
+   struct scoped_current_handler
+   {
+      scoped_current_handler(const execution_priority_queue& q, const queued_handler_base& h)
+         : prev_(current_handler_), prev_queue_(current_queue_), tag_(h.tag()) { current_handler_ = &h; current_queue_ = &q; }
+      ~scoped_current_handler() { current_handler_ = prev_; current_queue_ = prev_queue_; }
+      const queued_handler_base* prev_;
+      const execution_priority_queue* prev_queue_;
+      scoped_tag tag_;
+   };
+
+   // binary max-heap where each handler knows its index so it can be moved when its priority changes
+   void push(handler_ptr h)
+   {
+      if (h->tag() < held_tags_.size() && held_tags_[h->tag()] > 0) {
+         h->held_ = true;
+         h->heap_index_ = held_.size();
+         held_.push_back(std::move(h));
+         return;
+      }
+      h->heap_index_ = handlers_.size();
+      handlers_.push_back(std::move(h));
+      sift_up(handlers_.size() - 1);
+   }
+
+   // handler is removed from the heap before it executes so it may safely add to the queue
+   handler_ptr pop()
+   {
+      return remove(0);
+   }
+
+   handler_ptr remove(size_t i)
+   {
+      swap_at(i, handlers_.size() - 1);
+      handler_ptr h = std::move(handlers_.back());
+      handlers_.pop_back();
+      if (i < handlers_.size())
+         sift_down(sift_up(i));
+      release_references(*h);
+      return h;
+   }
+
+   // held handlers are kept in the order they were added, see hold()
+   void remove_held(size_t i)
+   {
+      handler_ptr h = std::move(held_[i]);
+      held_.erase(held_.begin() + i);
+      for (; i < held_.size(); ++i)
+         held_[i]->heap_index_ = i;
+      release_references(*h);
+   }
+
+   void release_references(queued_handler_base& h)
+   {
+      if (h.unique_) {
+         unique_.erase(*h.unique_);
+         h.unique_.reset();
+      }
+      if (h.task_) {
+         h.task_->handler_ = nullptr;
+         h.task_.reset();
+      }
+   }
+
+   size_t sift_up(size_t i)
+   {
+      while (i > 0) {
+         size_t parent = (i - 1) / 2;
+         if (!(*handlers_[parent] < *handlers_[i]))
+            break;
+         swap_at(i, parent);
+         i = parent;
+      }
+      return i;
+   }
+
+   size_t sift_down(size_t i)
+   {
+      const size_t n = handlers_.size();
+      while (true) {
+         size_t child = 2 * i + 1;
+         if (child >= n)
+            break;
+         if (child + 1 < n && *handlers_[child] < *handlers_[child + 1])
+            ++child;
+         if (!(*handlers_[i] < *handlers_[child]))
+            break;
+         swap_at(i, child);
+         i = child;
+      }
+      return i;
+   }
+
+   void swap_at(size_t a, size_t b)
+   {
+      std::swap(handlers_[a], handlers_[b]);
+      handlers_[a]->heap_index_ = a;
+      handlers_[b]->heap_index_ = b;
+   }
+
+   void execute(handler_ptr hp)
+   {
+      queued_handler_base& h = *hp;
+      if (!fair_levels_.empty()) {
+         auto itr = fair_levels_.find(h.priority());
+         if (itr != fair_levels_.end())
+            itr->second.vtime = std::max(itr->second.vtime, h.virtual_start());
       }
+      scoped_current_handler g(*this, h);
+      h.execute();
+   }
+
+   // start-time fair queuing: each handler of a tag advances the tag's virtual finish time by
+   // fair_quantum / weight, and handlers are served in order of virtual start time. This is the
+   // heap equivalent of weighted deficit round-robin between the tags of a level.
+   static constexpr uint64_t fair_quantum = 1u << 20;
+
+   struct fair_level
+   {
+      uint64_t              vtime = 0;  // virtual start time of the last handler executed at this level
+      std::vector<uint64_t> finish;     // virtual finish time of the last handler added, per tag
    };
 
-   using prio_queue = std::priority_queue<std::unique_ptr<queued_handler_base>, std::deque<std::unique_ptr<queued_handler_base>>, deref_less>;
-   prio_queue handlers_;
+   uint64_t virtual_start(int priority, queue_tag tag)
+   {
+      if (fair_levels_.empty())
+         return 0;
+      auto itr = fair_levels_.find(priority);
+      if (itr == fair_levels_.end())
+         return 0;
+      fair_level& level = itr->second;
+      if (level.finish.size() <= tag)
+         level.finish.resize(tag + 1, 0);
+      uint64_t start = std::max(level.vtime, level.finish[tag]);
+      uint32_t weight = tag < tag_weights_.size() ? tag_weights_[tag] : 1;
+      level.finish[tag] = start + fair_quantum / weight;
+      return start;
+   }
+
+   inline static thread_local const queued_handler_base* current_handler_ = nullptr;
+   inline static thread_local const execution_priority_queue* current_queue_ = nullptr;
+   inline static thread_local queue_tag current_tag_ = default_tag;
+   inline static thread_local uint32_t inline_depth_ = 0;
+
+   std::map<int, fair_level>                  fair_levels_;
+   std::vector<std::string>                   tag_names_{""};
+   std::vector<uint32_t>                      tag_weights_{1};
+   std::unordered_map<std::string, queue_tag> tag_ids_;
+
+   handler_pool pool_; // must outlive handlers_ and unique_
+   unique_map unique_;
+
+   // binary max-heap, see push()
+   std::vector<handler_ptr> handlers_;
+
+   // handlers added under a held tag, in the order they were added, and the number of holds per tag, see hold()
+   std::vector<handler_ptr> held_;
+   std::vector<uint32_t>    held_tags_;
 };
 
+inline void execution_priority_queue::handler_deleter::operator()(queued_handler_base* h) const noexcept
+{
+   if (size_t size = h->alloc_size_) {
+      std::pmr::memory_resource* r = h->resource_;
+      h->~queued_handler_base();
+      if (r)
+         r->deallocate(h, size, alignof(std::max_align_t));
+      else
+         pool->deallocate(h, size);
+   } else {
+      delete h;
+   }
+}
+
 } // appbase
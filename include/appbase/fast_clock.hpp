@@ -0,0 +1,128 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <cpuid.h>
+#include <x86intrin.h>
+#define APPBASE_FAST_CLOCK_TSC 1
+#elif defined(__aarch64__) && (defined(__GNUC__) || defined(__clang__))
+#define APPBASE_FAST_CLOCK_CNTVCT 1
+#endif
+
+namespace appbase {
+
+/**
+ * std::chrono clock for instrumentation, costing a few nanoseconds per reading.
+ *
+ * Reads the invariant TSC on x86-64 or the virtual counter (cntvct_el0) on ARM64 and converts it to nanoseconds
+ * on the time line of std::chrono::steady_clock, calibrated once against it. Falls back to steady_clock when the
+ * counter is not usable (no invariant TSC, other architectures).
+ *
+ * Calibration takes about 10ms on first use; the application performs it at construction.
+ *
+ * Example:
+ *   auto start = appbase::fast_clock::now();
+ *   ...
+ *   auto elapsed = appbase::fast_clock::now() - start;
+ */
+struct fast_clock {
+   using rep                       = int64_t;
+   using period                    = std::nano;
+   using duration                  = std::chrono::nanoseconds;
+   using time_point                = std::chrono::time_point<fast_clock>;
+   static constexpr bool is_steady = true;
+
+   static time_point now() noexcept {
+      const auto& c = calibration();
+      if (!c.use_counter)
+         return time_point(duration(steady_ns()));
+      return time_point(duration(c.to_ns(ticks())));
+   }
+
+   /**
+    * std::chrono::system_clock minus fast_clock, now: added to a recent reading it gives nanoseconds since the
+    * system_clock epoch, for timestamps shown to users. It changes as the system clock is adjusted (e.g. by NTP)
+    * and as the counter drifts from its calibration, so users keep remeasuring it, the logging thread every second.
+    */
+   static int64_t system_offset_ns() noexcept {
+      const int64_t sys = std::chrono::duration_cast<duration>(std::chrono::system_clock::now().time_since_epoch()).count();
+      return sys - now().time_since_epoch().count();
+   }
+
+   /// true if now() reads the cycle counter, false if it falls back to steady_clock
+   static bool uses_counter() noexcept { return calibration().use_counter; }
+
+   /// calibrate now rather than on the first now()
+   static void calibrate() { calibration(); }
+
+private:
+   struct calibration_t {
+      bool     use_counter      = false;
+      uint64_t base_ticks       = 0;
+      int64_t  base_ns          = 0;
+      uint64_t ns_per_tick      = 0; ///< 32.32 fixed point
+
+      int64_t to_ns(uint64_t t) const noexcept {
+         const auto delta = static_cast<__int128>(static_cast<int64_t>(t - base_ticks));
+         return base_ns + static_cast<int64_t>((delta * static_cast<__int128>(ns_per_tick)) >> 32);
+      }
+   };
+
+   static int64_t steady_ns() noexcept {
+      return std::chrono::duration_cast<duration>(std::chrono::steady_clock::now().time_since_epoch()).count();
+   }
+
+   static uint64_t ticks() noexcept {
+#if defined(APPBASE_FAST_CLOCK_TSC)
+      return __rdtsc();
+#elif defined(APPBASE_FAST_CLOCK_CNTVCT)
+      uint64_t v;
+      asm volatile("mrs %0, cntvct_el0" : "=r"(v));
+      return v;
+#else
+      return 0;
+#endif
+   }
+
+   static bool counter_usable() noexcept {
+#if defined(APPBASE_FAST_CLOCK_TSC)
+      unsigned eax, ebx, ecx, edx;
+      // CPUID.80000007H:EDX[8] invariant TSC: constant rate across P-, C- and T-states
+      return __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) && (edx & (1u << 8));
+#elif defined(APPBASE_FAST_CLOCK_CNTVCT)
+      return true;
+#else
+      return false;
+#endif
+   }
+
+   static calibration_t make_calibration() {
+      calibration_t c;
+      if (!counter_usable())
+         return c;
+
+      const int64_t  ns0 = steady_ns();
+      const uint64_t t0  = ticks();
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      const int64_t  ns1 = steady_ns();
+      const uint64_t t1  = ticks();
+      if (t1 <= t0 || ns1 <= ns0)
+         return c;
+
+      c.ns_per_tick = static_cast<uint64_t>((static_cast<unsigned __int128>(ns1 - ns0) << 32) / (t1 - t0));
+      c.base_ticks  = t1;
+      c.base_ns     = ns1;
+      c.use_counter = c.ns_per_tick != 0;
+      return c;
+   }
+
+   static const calibration_t& calibration() noexcept {
+      static const calibration_t c = make_calibration();
+      return c;
+   }
+};
+
+} // namespace appbase
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <appbase/execution_priority_queue.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace appbase {
+
+/**
+ * Attribution of heap allocations to the plugin whose code makes them, enabled by the `heap-accounting` option.
+ *
+ * Allocations are counted against execution_priority_queue::current_tag(): the tag of the plugin during its
+ * lifecycle calls, of the handler being executed, and of the plugin which subscribed to a channel or registered a
+ * method provider while it is being called. A free is counted against the tag of the allocation, whichever thread
+ * frees it. Only subscribers and providers registered while counting is enabled run under the tag of their plugin
+ * (see execution_priority_queue::bind_current_tag()), others run under the tag of the publisher or caller, so that
+ * the tags of handlers they post, which fair queueing schedules by, are unchanged when counting is disabled.
+ *
+ * Counting requires the replacement operator new/delete of the `appbase_heap_accounting` library, linked into the
+ * executable in addition to appbase; they add a 16 byte header to every allocation, counted or not, and keep
+ * per-thread counters so that counting takes no lock and no read-modify-write. Memory obtained with malloc() and
+ * allocations made while counting was disabled are not counted. Tags beyond max_tags are counted as the default tag.
+ *
+ * Per-plugin usage is reported by app().heap_usage(); allocation rates are the difference between two reports.
+ */
+class heap_accounting {
+public:
+   static constexpr size_t max_tags = 256;
+
+   /// tag stored with allocations which are not counted
+   static constexpr uint32_t untracked = UINT32_MAX;
+
+   struct usage {
+      int64_t  live_bytes      = 0; ///< allocated and not yet freed
+      uint64_t allocations     = 0;
+      uint64_t allocated_bytes = 0; ///< total ever allocated
+      uint64_t frees           = 0;
+   };
+
+   /// whether the replacement operator new/delete are linked in
+   static bool interposed() { return interposed_.load(std::memory_order_relaxed); }
+
+   /// start or stop counting allocations made from now on
+   static void enable(bool on) { enabled_.store(on, std::memory_order_relaxed); }
+   static bool enabled() { return enabled_.load(std::memory_order_relaxed); }
+
+   /// usage of every tag below max_tags, indexed by tag, summed over all threads
+   static std::vector<usage> snapshot();
+
+   /// usage of `tag`
+   static usage get(execution_priority_queue::queue_tag tag);
+
+   /// called by the replacement operator new, @return the tag to store with the allocation
+   static uint32_t on_alloc(size_t size) noexcept;
+
+   /// called by the replacement operator delete with the tag stored by on_alloc()
+   static void on_free(uint32_t tag, size_t size) noexcept;
+
+   /// called once by the replacement operators when they are linked in
+   static void set_interposed() { interposed_.store(true, std::memory_order_relaxed); }
+
+private:
+   inline static std::atomic<bool> interposed_{false};
+   inline static std::atomic<bool> enabled_{false};
+};
+
+} // namespace appbase
@@ -0,0 +1,382 @@
+#pragma once
+
+#include <appbase/fast_clock.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <new>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+/**
+ * Records below this log_level are compiled out of the APPBASE_*LOG macros. Define it before including this header
+ * to filter a translation unit, e.g. a plugin, at compile time: 0 debug, 1 info, 2 warn, 3 error, 4 off.
+ */
+#ifndef APPBASE_LOG_LEVEL
+#define APPBASE_LOG_LEVEL 0
+#endif
+
+/**
+ * Log through `LOGGER` (an appbase::logger) if `LEVEL` passes the compile time and runtime filters.
+ * The remaining arguments are a format string literal with `{}` placeholders followed by their arguments, see
+ * logger::write().
+ */
+#define APPBASE_LOG(LOGGER, LEVEL, ...)                                                                                \
+   do {                                                                                                                \
+      if constexpr (static_cast<int>(LEVEL) >= APPBASE_LOG_LEVEL) {                                                    \
+         const ::appbase::logger& appbase_logger_ = (LOGGER);                                                          \
+         if (appbase_logger_.enabled(LEVEL))                                                                           \
+            appbase_logger_.write(LEVEL, __FILE__, __LINE__, __VA_ARGS__);                                             \
+      }                                                                                                                \
+   } while (false)
+
+#define APPBASE_DLOG(LOGGER, ...) APPBASE_LOG(LOGGER, ::appbase::log_level::debug, __VA_ARGS__)
+#define APPBASE_ILOG(LOGGER, ...) APPBASE_LOG(LOGGER, ::appbase::log_level::info, __VA_ARGS__)
+#define APPBASE_WLOG(LOGGER, ...) APPBASE_LOG(LOGGER, ::appbase::log_level::warn, __VA_ARGS__)
+#define APPBASE_ELOG(LOGGER, ...) APPBASE_LOG(LOGGER, ::appbase::log_level::error, __VA_ARGS__)
+
+namespace appbase {
+
+/**
+ * Asynchronous logging shared by appbase and its plugins.
+ *
+ * A record is written by the logging thread, not the caller: the caller only copies the format string's address
+ * and the arguments into a lock-free buffer owned by its thread, and the logging thread formats them later. When
+ * that buffer is full the record is dropped and counted rather than waiting, so logging never blocks the main
+ * loop. Records go to std::cerr, or to a file rotated by size. The logging thread sleeps while every buffer is
+ * empty; the record which makes a drained buffer non-empty wakes it.
+ *
+ * The application starts the logging thread in initialize() from its `log-*` options and stops it, after writing
+ * every queued record, when it is destroyed. While it is not running records are formatted and written to
+ * std::cerr by the caller.
+ *
+ * Example:
+ *   APPBASE_ILOG(appbase::get_logger("net_plugin"), "connected to {} after {} ms", peer, elapsed);
+ */
+enum class log_level : uint8_t { debug, info, warn, error, off };
+
+const char* to_string(log_level level);
+std::optional<log_level> log_level_from_string(std::string_view name);
+
+class logger;
+
+namespace detail {
+   inline constexpr size_t log_record_align = alignof(std::max_align_t);
+
+   constexpr size_t log_align_up(size_t n) { return (n + log_record_align - 1) & ~(log_record_align - 1); }
+
+   /// a string argument, whose bytes the caller copies into the record after the arguments
+   struct log_str {
+      uint32_t offset; ///< from the start of the arguments
+      uint32_t size;
+   };
+
+   // the caller's strings may be gone when the record is formatted, so their bytes are copied
+   template <typename T>
+   struct log_arg { using type = T; };
+   template <>
+   struct log_arg<const char*> { using type = log_str; };
+   template <>
+   struct log_arg<char*> { using type = log_str; };
+   template <>
+   struct log_arg<std::string_view> { using type = log_str; };
+   template <>
+   struct log_arg<std::string> { using type = log_str; };
+
+   template <typename T>
+   using log_arg_t = typename log_arg<std::decay_t<T>>::type;
+
+   template <typename T>
+   std::string_view log_str_view(const T& a) {
+      if constexpr (std::is_pointer_v<T>)
+         return a ? std::string_view(a) : std::string_view();
+      else
+         return a;
+   }
+
+   /// bytes of `a` copied after the arguments
+   template <typename T>
+   size_t log_str_size(const T& a) {
+      if constexpr (std::is_same_v<log_arg_t<T>, log_str>)
+         return log_str_view(a).size();
+      else
+         return 0;
+   }
+
+   template <typename T>
+   decltype(auto) log_store(T&& a, std::byte* args, size_t& offset) {
+      if constexpr (std::is_same_v<log_arg_t<T>, log_str>) {
+         const std::string_view s = log_str_view(a);
+         std::memcpy(args + offset, s.data(), s.size());
+         const log_str r{static_cast<uint32_t>(offset), static_cast<uint32_t>(s.size())};
+         offset += s.size();
+         return r;
+      } else {
+         return std::forward<T>(a);
+      }
+   }
+
+   /// construct the arguments `Tuple` at `p`, followed by the bytes of its string arguments, @return p
+   template <typename Tuple, typename... Args>
+   void* log_store_args(std::byte* p, Args&&... args) {
+      size_t offset = sizeof(Tuple);
+      // braced initialization stores the strings in argument order
+      return new (p) Tuple{log_store(std::forward<Args>(args), p, offset)...};
+   }
+
+   template <typename T>
+   const T& log_load(const T& a, const void*) { return a; }
+   inline std::string_view log_load(const log_str& a, const void* args) {
+      return {static_cast<const char*>(args) + a.offset, a.size};
+   }
+
+   inline void format_args(std::ostream& os, const char* fmt) { os << fmt; }
+
+   template <typename T, typename... Rest>
+   void format_args(std::ostream& os, const char* fmt, const T& first, const Rest&... rest) {
+      const char* p = std::strstr(fmt, "{}");
+      if (!p) {
+         os << fmt;
+         return;
+      }
+      os.write(fmt, p - fmt);
+      os << first;
+      format_args(os, p + 2, rest...);
+   }
+
+   /**
+    * Header of a record in a log_buffer, followed by its arguments
+    */
+   struct alignas(log_record_align) log_record {
+      using format_fn = void (*)(std::ostream& os, const char* fmt, void* args); ///< formats, then destroys args
+
+      uint32_t      size; ///< bytes including the header, 0 marks the unused end of the buffer before wrapping
+      log_level     level;
+      uint32_t      line;
+      const logger* source;
+      const char*   fmt;
+      const char*   file;
+      int64_t       time_ns; ///< fast_clock
+      format_fn     format;
+   };
+
+   inline constexpr size_t log_header_size = log_align_up(sizeof(log_record));
+
+   template <typename Tuple>
+   void format_tuple(std::ostream& os, const char* fmt, void* p) {
+      struct destroy {
+         Tuple* args;
+         ~destroy() { args->~Tuple(); }
+      } d{static_cast<Tuple*>(p)};
+      std::apply([&](const auto&... a) { format_args(os, fmt, log_load(a, p)...); }, *d.args);
+   }
+
+   /**
+    * Single producer, single consumer ring of variable size records
+    */
+   class log_buffer {
+   public:
+      log_buffer(size_t capacity, uint32_t thread_index);
+      ~log_buffer();
+
+      log_buffer(const log_buffer&) = delete;
+      log_buffer& operator=(const log_buffer&) = delete;
+
+      /// producer: contiguous storage for a record of `size` bytes (a multiple of log_record_align), or nullptr if full
+      void* try_reserve(size_t size) {
+         const size_t head = head_.load(std::memory_order_relaxed);
+         const size_t pos  = head & (capacity_ - 1);
+         const size_t skip = (size > capacity_ - pos) ? capacity_ - pos : 0;
+         if (head + skip + size - tail_.load(std::memory_order_acquire) > capacity_)
+            return nullptr;
+         if (skip)
+            reinterpret_cast<log_record*>(data_ + pos)->size = 0;
+         reserved_ = head + skip + size;
+         return data_ + ((head + skip) & (capacity_ - 1));
+      }
+
+      /**
+       * producer: publish the record written to the storage returned by the last try_reserve()
+       * @return whether the consumer had drained the buffer before this record, so may be waiting for records
+       */
+      bool commit() {
+         const size_t prev = head_.load(std::memory_order_relaxed);
+         head_.store(reserved_, std::memory_order_release);
+         // pairs with the fence of the consumer between announcing it waits and checking the buffers
+         std::atomic_thread_fence(std::memory_order_seq_cst);
+         return tail_.load(std::memory_order_relaxed) == prev;
+      }
+
+      /// consumer: call `f(record, args)` for each published record, @return the number of records
+      template <typename F>
+      size_t consume(F&& f) {
+         size_t       tail = tail_.load(std::memory_order_relaxed);
+         const size_t head = head_.load(std::memory_order_acquire);
+         size_t       n    = 0;
+         while (tail != head) {
+            const size_t pos = tail & (capacity_ - 1);
+            auto*        rec = reinterpret_cast<log_record*>(data_ + pos);
+            if (rec->size == 0) {
+               tail += capacity_ - pos;
+            } else {
+               f(*rec, data_ + pos + log_header_size);
+               tail += rec->size;
+               ++n;
+            }
+            tail_.store(tail, std::memory_order_release);
+         }
+         return n;
+      }
+
+      bool empty() const { return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_relaxed); }
+      size_t capacity() const { return capacity_; }
+
+      const uint32_t        thread_index;
+      std::atomic<uint64_t> dropped{0};   ///< records dropped because the buffer was full
+      std::atomic<bool>     closed{false}; ///< the producer thread has exited
+
+   private:
+      size_t                             capacity_; // power of 2
+      std::byte*                         data_;     // memory_residency region
+      size_t                             reserved_ = 0;
+      alignas(64) std::atomic<size_t>    head_{0};
+      alignas(64) std::atomic<size_t>    tail_{0};
+   };
+} // namespace detail
+
+// ------------------------------------------------------------------------------------------
+/**
+ * A named source of records with its own runtime level, e.g. one per plugin.
+ */
+class logger {
+public:
+   logger(std::string name, log_level level) : name_(std::move(name)), level_(level) {}
+
+   logger(const logger&) = delete;
+   logger& operator=(const logger&) = delete;
+
+   const std::string& name() const { return name_; }
+
+   log_level level() const { return level_.load(std::memory_order_relaxed); }
+   void set_level(log_level level) { level_.store(level, std::memory_order_relaxed); }
+   bool enabled(log_level level) const { return level >= this->level() && level != log_level::off; }
+
+   /**
+    * Queue a record, formatted on the logging thread by writing each of `args` with operator<< in place of the
+    * next `{}` of `fmt`. `fmt` is kept by address and must be a string literal. The bytes of string arguments
+    * (character pointers, std::string_view and std::string) are copied into the record, other arguments are copied
+    * or moved as they are so they must not refer to memory which may be released.
+    * The first record logged from a thread allocates that thread's buffer.
+    */
+   template <typename... Args>
+   void write(log_level level, const char* file, uint32_t line, const char* fmt, Args&&... args) const;
+
+private:
+   std::string            name_;
+   std::atomic<log_level> level_;
+};
+
+/**
+ * @return the logger `name`, created on first use at its configured level; the reference remains valid
+ */
+logger& get_logger(std::string_view name);
+
+struct log_config {
+   std::filesystem::path file;                       ///< empty to log to std::cerr
+   uint64_t              rotate_size  = 256ull << 20; ///< bytes after which the file is rotated
+   uint32_t              rotate_count = 8;            ///< rotated files kept as file.1 (newest) to file.N
+   size_t                buffer_size  = 1 << 20;      ///< bytes of each thread's buffer, created after start()
+   log_level             level        = log_level::info;
+   std::map<std::string, log_level, std::less<>> levels; ///< per logger overrides of `level`
+};
+
+/**
+ * The logging thread and the per-thread buffers it drains.
+ */
+class log_backend {
+public:
+   static log_backend& instance();
+
+   ~log_backend();
+
+   /// apply the levels of `config` to all loggers and start the logging thread, restarting it if running
+   void start(log_config config);
+
+   /// write every queued record and stop the logging thread
+   void stop();
+
+   bool running() const { return running_.load(std::memory_order_acquire); }
+
+   /// wait until the records queued before the call have been written
+   void flush();
+
+   /// @return the number of records dropped because a thread's buffer was full
+   uint64_t dropped() const;
+
+   /// the calling thread's buffer
+   detail::log_buffer& thread_buffer();
+
+   /// format and write a record on the calling thread
+   void write_now(const detail::log_record& rec, void* args);
+
+   /// wake the logging thread if it waits for records, after commit() found the buffer drained
+   void notify_record() {
+      if (waiting_.load(std::memory_order_relaxed))
+         wake();
+   }
+
+private:
+   log_backend();
+   void wake();
+
+   struct impl;
+   std::unique_ptr<impl> my;
+   std::atomic<bool>     running_{false};
+   std::atomic<bool>     waiting_{false}; ///< the logging thread found every buffer empty and waits
+};
+
+// ------------------------------------------------------------------------------------------
+template <typename... Args>
+void logger::write(log_level level, const char* file, uint32_t line, const char* fmt, Args&&... args) const {
+   using args_t = std::tuple<detail::log_arg_t<Args>...>;
+   static_assert(alignof(args_t) <= detail::log_record_align, "over-aligned log argument");
+   const size_t args_size = detail::log_align_up(sizeof(args_t) + (size_t(0) + ... + detail::log_str_size(args)));
+   const size_t size      = detail::log_header_size + args_size;
+
+   const int64_t now = fast_clock::now().time_since_epoch().count();
+   const detail::log_record header{static_cast<uint32_t>(size), level, line, this, fmt, file, now,
+                                   &detail::format_tuple<args_t>};
+
+   auto& backend = log_backend::instance();
+   if (!backend.running()) {
+      alignas(detail::log_record_align) std::byte local[256];
+      std::unique_ptr<std::byte[]> heap;
+      std::byte* storage = args_size <= sizeof(local) ? local : (heap = std::make_unique<std::byte[]>(args_size)).get();
+      backend.write_now(header, detail::log_store_args<args_t>(storage, std::forward<Args>(args)...));
+      return;
+   }
+
+   auto& buf = backend.thread_buffer();
+   void* p   = size <= buf.capacity() ? buf.try_reserve(size) : nullptr;
+   if (!p) {
+      buf.dropped.fetch_add(1, std::memory_order_relaxed);
+      return;
+   }
+   detail::log_store_args<args_t>(static_cast<std::byte*>(p) + detail::log_header_size, std::forward<Args>(args)...);
+   new (p) detail::log_record(header);
+   if (buf.commit())
+      backend.notify_record();
+}
+
+} // namespace appbase
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+namespace appbase {
+
+/**
+ * Watches the memory use of the process and asks registered shrinkers to release memory when it crosses the
+ * thresholds configured by the `memory-pressure-*` options, before the kernel's oom-killer has to.
+ *
+ * A thread samples the resident set size, the memory.current and memory.max of the process's cgroup (v2) and the
+ * memory pressure stall information (PSI) every interval. When a threshold is crossed a shrink is posted to the
+ * executor at the configured priority: shrinkers run on the main loop in decreasing `order`, each given the bytes
+ * still to release, until the target is met. No other shrink is posted until it has run. When a shrink did not
+ * lower the bytes over the threshold by the next sample, the following one waits for twice as many samples as the
+ * previous wait, up to max_backoff, since releasing memory did not help (e.g. freed heap not returned to the OS).
+ * Monitoring is off unless a threshold is configured.
+ *
+ * Example:
+ *   _shrinker = app().get_memory_pressure().add_shrinker(10, "state_cache", [this](size_t target) {
+ *      return _state_cache.drop_oldest(target); // bytes released
+ *   });
+ */
+class memory_pressure {
+public:
+   struct sample {
+      uint64_t rss            = 0; ///< resident set size of the process in bytes
+      uint64_t cgroup_current = 0; ///< memory.current less inactive_file of the process's cgroup, 0 if unavailable
+      uint64_t cgroup_max     = 0; ///< memory.max of the process's cgroup, 0 if unlimited or unavailable
+      double   psi_some_avg10 = 0; ///< % of the last 10s some task stalled on memory, cgroup's or system wide
+   };
+
+   struct config {
+      std::chrono::milliseconds interval{1000};       ///< between samples, 0 disables monitoring
+      uint64_t                  rss_limit      = 0;   ///< bytes of RSS above which to shrink, 0 to ignore
+      double                    cgroup_percent = 0;   ///< % of memory.max above which to shrink, 0 to ignore
+      double                    psi_avg10      = 0;   ///< some avg10 above which to shrink, 0 to ignore
+      double                    psi_release    = 10;  ///< % of RSS to release on memory pressure stalls
+      int                       priority       = 100; ///< of the posted shrink
+   };
+
+   using shrink_fn = std::function<size_t(size_t target_bytes)>; ///< @return the bytes released
+   using post_fn   = std::function<void(int priority, std::function<void()>)>;
+
+   /**
+    * Registration of a shrinker, removed when destroyed
+    */
+   class handle {
+   public:
+      handle() = default;
+      handle(handle&& o) noexcept : mp_(o.mp_), id_(o.id_) { o.mp_ = nullptr; }
+      handle& operator=(handle&& o) noexcept;
+      ~handle() { reset(); }
+
+      void reset();
+
+   private:
+      friend class memory_pressure;
+      handle(memory_pressure* mp, uint64_t id) : mp_(mp), id_(id) {}
+
+      memory_pressure* mp_ = nullptr;
+      uint64_t         id_ = 0;
+   };
+
+   explicit memory_pressure(post_fn post);
+   ~memory_pressure();
+
+   memory_pressure(const memory_pressure&) = delete;
+   memory_pressure& operator=(const memory_pressure&) = delete;
+
+   /**
+    * Register `fn`, called on the main loop with the bytes to release when memory is short. Shrinkers of higher
+    * `order` run first, e.g. those whose memory is the cheapest to rebuild.
+    */
+   [[nodiscard]] handle add_shrinker(int order, std::string name, shrink_fn fn);
+
+   /// start the sampling thread, restarting it if running
+   void start(config cfg);
+   void stop();
+
+   /// replace the function taking samples, read_sample() by default
+   void set_sampler(std::function<sample()> sampler);
+
+   /// sample the calling process from /proc and its cgroup
+   static sample read_sample();
+
+   /// @return the bytes to release for `s` under `cfg`, 0 when no threshold is crossed
+   static uint64_t target_for(const sample& s, const config& cfg);
+
+   /**
+    * Run the shrinkers on the calling thread until `target` bytes have been released
+    * @return the bytes released
+    */
+   size_t shrink(size_t target);
+
+   /// samples skipped at most between two shrinks which do not help
+   static constexpr unsigned max_backoff = 64;
+
+   struct stats {
+      uint64_t events   = 0; ///< shrinks run
+      uint64_t released = 0; ///< bytes released by shrinkers
+      uint64_t skipped  = 0; ///< samples over a threshold on which no shrink was posted, backing off
+      sample   last;         ///< latest sample
+   };
+   stats get_stats() const;
+
+private:
+   struct impl;
+   std::unique_ptr<impl> my;
+};
+
+} // namespace appbase
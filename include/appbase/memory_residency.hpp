@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace appbase {
+
+enum class hugepage_mode : uint8_t {
+   off,         ///< regular pages
+   transparent, ///< 2MiB aligned regions advised with MADV_HUGEPAGE
+   hugetlb      ///< explicit hugepages (MAP_HUGETLB), falling back to transparent when none are reserved
+};
+
+const char* to_string(hugepage_mode mode);
+std::optional<hugepage_mode> hugepage_mode_from_string(std::string_view name);
+
+/**
+ * Keeps the memory appbase uses on the main loop resident, configured by the application's `mlockall`, `hugepages`,
+ * `prefault-stack-kb` and `prefault-handler-slabs` options.
+ *
+ * Pools owned by appbase (the priority queue's handler slabs, log buffers) obtain their memory through
+ * allocate_region() so that they are backed by hugepages when enabled. All members are process wide and thread safe.
+ */
+class memory_residency {
+public:
+   static constexpr size_t hugepage_size = 2 * 1024 * 1024;
+
+   static void set_hugepages(hugepage_mode mode);
+   static hugepage_mode hugepages();
+
+   /// size a pool should request for a region it would otherwise allocate as `size` bytes
+   static size_t region_size(size_t size);
+
+   /// page aligned region of `size` bytes, throws std::bad_alloc
+   static void* allocate_region(size_t size);
+   static void deallocate_region(void* p, size_t size) noexcept;
+
+   /// mlockall(MCL_CURRENT | MCL_FUTURE), @return an empty string on success or the error
+   static std::string lock_all();
+
+   /// bytes of stack the calling thread faults in with prefault_stack()
+   static void set_stack_prefault(size_t bytes);
+   static size_t stack_prefault();
+
+   /// fault in stack_prefault() bytes of the calling thread's stack, bounded by the room left on that stack
+   /// @return the number of bytes faulted in
+   static size_t prefault_stack();
+
+   struct stats {
+      size_t   region_bytes  = 0; ///< bytes of live regions
+      size_t   hugetlb_bytes = 0; ///< bytes of regions allocated with explicit hugepages, including released ones
+      uint64_t fallbacks     = 0; ///< hugepage-sized hugetlb allocations which fell back to transparent hugepages
+   };
+   static stats get_stats();
+};
+
+} // namespace appbase
@@ -7,6 +7,10 @@
 #include <boost/signals2.hpp>
 #include <boost/exception/diagnostic_information.hpp>
 
+#include <appbase/activation_hook.hpp>
+#include <appbase/execution_priority_queue.hpp>
+#include <appbase/heap_accounting.hpp>
+
 namespace appbase {
 
    class application_base;
@@ -156,10 +160,12 @@ namespace appbase {
             template<typename ...FuncArgs>
             Ret operator()(FuncArgs&&... args)
             {
+               _activation();
                return _signal(std::forward<FuncArgs>(args)...);
             }
 
             signal_type _signal;
+            activation_hook _activation;
       };
 
       template<typename ...Args, typename DispatchPolicy>
@@ -178,10 +184,12 @@ namespace appbase {
             template<typename ...FuncArgs>
             void operator()(FuncArgs&&... args)
             {
+               _activation();
                _signal(std::forward<FuncArgs>(args)...);
             }
 
             signal_type _signal;
+            activation_hook _activation;
       };
    }
 
@@ -245,7 +253,8 @@ namespace appbase {
          };
 
          /**
-          * Register a provider of this method
+          * Register a provider of this method, which runs under the queue tag of the registering plugin when
+          * heap_accounting is enabled, and under the caller's otherwise
           *
           * @tparam T - the type of the provider (functor, lambda)
           * @param provider - the provider
@@ -253,7 +262,13 @@ namespace appbase {
           */
          template<typename T>
          handle register_provider(T provider, int priority = 0) {
-            return handle(this->_signal.connect(priority, provider));
+            if constexpr (std::is_base_of_v<boost::signals2::slot_base, T>)
+               return handle(this->_signal.connect(priority, provider)); // keeps the objects it tracks
+            else if (heap_accounting::enabled())
+               return handle(
+                  this->_signal.connect(priority, execution_priority_queue::bind_current_tag(std::move(provider))));
+            else
+               return handle(this->_signal.connect(priority, std::move(provider)));
          }
 
       protected:
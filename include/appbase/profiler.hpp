@@ -0,0 +1,70 @@
+#pragma once
+
+#include <appbase/execution_priority_queue.hpp>
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <ostream>
+#include <string>
+
+namespace appbase {
+
+/**
+ * Sampling CPU profiler of a single thread, the main thread when started from the `profile-hz` option.
+ *
+ * A SIGPROF timer on the thread's CPU time interrupts it `hz` times per CPU second; the signal handler records the
+ * stack together with the queue tag (the plugin) and the label of the handler being executed, into a fixed ring
+ * buffer without allocating or locking. A background thread aggregates the ring twice a second; samples arriving
+ * while it is full are dropped.
+ *
+ * write_folded() emits one line per distinct stack in the folded format of flame graph tools:
+ *   <plugin>;<handler>;<outermost frame>;...;<innermost frame> <samples>
+ * so time spent under execution_priority_queue is split by plugin and handler. Frames are symbolized with dladdr(),
+ * functions of the executable need it linked with -rdynamic (ENABLE_EXPORTS) to be named. Linux only.
+ */
+class profiler {
+public:
+   struct config {
+      unsigned hz        = 99;      ///< samples per second of CPU time
+      size_t   ring_size = 4096;    ///< samples buffered until aggregated (twice a second), rounded to a power of 2
+   };
+
+   /// name of a queue tag in the profile
+   using tag_name_fn = std::function<std::string(execution_priority_queue::queue_tag)>;
+
+   static profiler& instance();
+
+   /**
+    * Start sampling the calling thread, restarting the profiler if running. Samples taken so far are kept.
+    * @return false if sampling is not available
+    */
+   bool start(config cfg);
+
+   void stop();
+   bool running() const;
+
+   /**
+    * Write the samples taken since the profiler was first started (or since clear()) as folded stacks.
+    * May be called from any thread, also while running.
+    */
+   void write_folded(std::ostream& os, const tag_name_fn& tag_name);
+
+   /// discard the samples taken so far
+   void clear();
+
+   struct stats {
+      uint64_t samples = 0; ///< recorded, counting timer expirations coalesced into one signal
+      uint64_t dropped = 0; ///< while the ring was full
+   };
+   stats get_stats() const;
+
+private:
+   profiler();
+   ~profiler();
+
+   struct impl;
+   std::unique_ptr<impl> my;
+};
+
+} // namespace appbase
@@ -0,0 +1,246 @@
+#pragma once
+
+#include <appbase/fast_clock.hpp>
+#include <appbase/reclaimer.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace appbase {
+
+/**
+ * Quiescent state based reclamation: objects unlinked from a structure shared with other threads are freed once
+ * every participating thread has passed a quiescent state, a point where it holds no reference into the structure.
+ * Readers then need no atomic read-modify-write, reference count or lock, see rcu_ptr.
+ *
+ * The main loop of the default_executor and the threads of an appbase::thread_pool created with the executor's
+ * domain are participants which announce a quiescent state between two of their handlers, so a reference obtained
+ * in a handler must not be kept beyond it. Other threads reading shared structures register a participant and call
+ * quiescent() themselves, going offline() while blocked.
+ *
+ * Once their grace period has elapsed retired objects are destroyed by the reclaimer, off the announcing thread when
+ * it runs. Participants blocked waiting for work are woken through their wakers so that grace periods complete
+ * while the application is idle.
+ */
+class qsbr {
+   struct record {
+      alignas(64) std::atomic<uint64_t> seen{0}; ///< epoch of the last quiescent state, 0 when offline
+   };
+
+   struct retired {
+      void*                 p;
+      reclaimer::destroy_fn destroy;
+      uint64_t              epoch; ///< freed once every online participant has announced it
+   };
+
+public:
+   /**
+    * RAII registration of the current thread as a participant, online from construction.
+    */
+   class participant {
+   public:
+      explicit participant(qsbr& domain) : q_(domain) {
+         std::lock_guard<std::mutex> g(q_.mtx_);
+         rec_ = q_.records_.emplace(q_.records_.end());
+         rec_->seen.store(q_.epoch_.load(std::memory_order_acquire), std::memory_order_relaxed);
+      }
+
+      ~participant() {
+         {
+            std::lock_guard<std::mutex> g(q_.mtx_);
+            q_.records_.erase(rec_);
+         }
+         if (q_.pending_.load(std::memory_order_relaxed))
+            q_.reclaim();
+      }
+
+      participant(const participant&) = delete;
+      participant& operator=(const participant&) = delete;
+
+      /**
+       * Announce that the thread holds no reference obtained before this call; a load and a store when nothing
+       * is waiting to be reclaimed.
+       */
+      void quiescent() {
+         rec_->seen.store(q_.epoch_.load(std::memory_order_acquire), std::memory_order_release);
+         if (q_.pending_.load(std::memory_order_relaxed))
+            q_.reclaim();
+      }
+
+      /// stop taking part in grace periods, e.g. before blocking; no reference may be held while offline
+      void offline() {
+         rec_->seen.store(0, std::memory_order_release);
+         if (q_.pending_.load(std::memory_order_relaxed))
+            q_.reclaim();
+      }
+
+      void online() {
+         // ordered before the reads which follow, against the scan of a concurrent reclaim()
+         rec_->seen.store(q_.epoch_.load(std::memory_order_acquire), std::memory_order_seq_cst);
+      }
+
+   private:
+      qsbr&                         q_;
+      std::list<record>::iterator   rec_;
+   };
+
+   qsbr() = default;
+
+   /// destroys the objects still retired, all participants must be gone
+   ~qsbr() {
+      for (auto& r : retired_)
+         r.destroy(r.p);
+   }
+
+   qsbr(const qsbr&) = delete;
+   qsbr& operator=(const qsbr&) = delete;
+
+   /**
+    * Destroy `p` once every participant online now has passed a quiescent state. `p` must already be unreachable
+    * for readers which have not obtained it yet.
+    */
+   void retire(void* p, reclaimer::destroy_fn destroy) {
+      {
+         std::lock_guard<std::mutex> g(mtx_);
+         retired_.push_back({p, destroy, epoch_.fetch_add(1, std::memory_order_acq_rel) + 1});
+         pending_.store(retired_.size(), std::memory_order_relaxed);
+      }
+      reclaim();
+   }
+
+   template <typename T>
+   void retire(const T* p) {
+      if (p)
+         retire(const_cast<T*>(p), &detail::reclaim_delete<T>);
+   }
+
+   /**
+    * Register a function invoked when a grace period waits for participants, used to wake participants that are
+    * blocked waiting for work so they reach their next quiescent state.
+    * @return handle to pass to remove_waker()
+    */
+   auto add_waker(std::function<void()> waker) {
+      std::lock_guard<std::mutex> g(mtx_);
+      return wakers_.insert(wakers_.end(), std::move(waker));
+   }
+
+   void remove_waker(std::list<std::function<void()>>::iterator itr) {
+      std::lock_guard<std::mutex> g(mtx_);
+      wakers_.erase(itr);
+   }
+
+   /// number of retired objects waiting for their grace period
+   size_t pending() const { return pending_.load(std::memory_order_relaxed); }
+
+   /// number of registered participants
+   size_t participants() const {
+      std::lock_guard<std::mutex> g(mtx_);
+      return records_.size();
+   }
+
+   /**
+    * Free the objects whose grace period has elapsed. Called by participants and retire(), skipped when another
+    * thread is already reclaiming.
+    */
+   void reclaim() {
+      std::vector<retired> ready;
+      {
+         std::unique_lock<std::mutex> g(mtx_, std::try_to_lock);
+         if (!g.owns_lock())
+            return;
+         uint64_t oldest = UINT64_MAX; // lowest epoch announced by an online participant
+         for (const auto& r : records_) {
+            const uint64_t seen = r.seen.load(std::memory_order_seq_cst);
+            if (seen)
+               oldest = std::min(oldest, seen);
+         }
+         while (!retired_.empty() && retired_.front().epoch <= oldest) {
+            ready.push_back(retired_.front());
+            retired_.pop_front();
+         }
+         pending_.store(retired_.size(), std::memory_order_relaxed);
+         // every participant woken announces at least the epoch of the objects still pending; wake again for later
+         // retirements or when a wakeup did not reach a participant
+         const uint64_t epoch = epoch_.load(std::memory_order_relaxed);
+         if (!retired_.empty() && !wakers_.empty()) {
+            const auto now = fast_clock::now();
+            if (woken_epoch_ < epoch || now - woken_at_ > rewake_interval) {
+               woken_epoch_ = epoch;
+               woken_at_    = now;
+               for (auto& w : wakers_)
+                  w();
+            }
+         }
+      }
+      for (auto& r : ready)
+         reclaimer::instance().retire(r.p, r.destroy);
+   }
+
+private:
+   static constexpr std::chrono::milliseconds rewake_interval{1};
+
+   mutable std::mutex                 mtx_;
+   alignas(64) std::atomic<uint64_t>  epoch_{1};
+   std::atomic<size_t>                pending_{0};
+   std::list<record>                  records_;
+   std::deque<retired>                retired_;
+   uint64_t                           woken_epoch_ = 0;
+   fast_clock::time_point             woken_at_;
+   std::list<std::function<void()>>   wakers_;
+};
+
+/**
+ * Pointer to a read-mostly object shared with other threads through a qsbr domain. Readers load() it without any
+ * read-modify-write; replaced objects are destroyed once no reader can still use them.
+ *
+ * Example:
+ *   appbase::rcu_ptr<routes> table{app().executor().get_qsbr(), std::make_unique<routes>()};
+ *   // any participant, the pointer is valid until its next quiescent state (the end of the current handler)
+ *   const routes* r = table.load();
+ *   // writers, one at a time, e.g. on the main loop
+ *   table.update([&](routes& next) { next.add(peer); });
+ */
+template <typename T>
+class rcu_ptr {
+public:
+   explicit rcu_ptr(qsbr& domain, std::unique_ptr<T> initial = {}) : q_(domain), p_(initial.release()) {}
+
+   ~rcu_ptr() {
+      q_.retire(p_.load(std::memory_order_relaxed));
+   }
+
+   rcu_ptr(const rcu_ptr&) = delete;
+   rcu_ptr& operator=(const rcu_ptr&) = delete;
+
+   const T* load() const { return p_.load(std::memory_order_acquire); }
+
+   /// publish `next` and retire the object it replaces
+   void store(std::unique_ptr<T> next) {
+      q_.retire(p_.exchange(next.release(), std::memory_order_acq_rel));
+   }
+
+   /// copy the current object, which must be set, let `f` modify the copy and publish it; writers must not run
+   /// concurrently
+   template <typename F>
+   void update(F&& f) {
+      assert(load());
+      auto next = std::make_unique<T>(*load());
+      std::forward<F>(f)(*next);
+      store(std::move(next));
+   }
+
+private:
+   qsbr&               q_;
+   std::atomic<T*>     p_;
+};
+
+} // namespace appbase
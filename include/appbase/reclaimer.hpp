@@ -0,0 +1,128 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+namespace appbase {
+
+/**
+ * Destroys objects handed to it on a background thread, so that releasing large object graphs (blocks, tries, ...)
+ * does not stall the thread which dropped the last reference, typically the main loop.
+ *
+ * Objects are opted in explicitly, with reclaim_later(), make_reclaimed_shared(), reclaim_captures() or
+ * channel::set_deferred_reclaim(). The backlog of objects waiting for destruction is bounded: an object retired while
+ * it is full, or while the reclaimer is not running, is destroyed by the caller and counted. Retiring an object never
+ * allocates, the backlog is reserved by start().
+ *
+ * A retired object must not refer to state which may be released before the reclaimer destroys it. The application
+ * starts the reclaimer in initialize() from its `reclaim-backlog` option and stops it, after destroying every retired
+ * object, when it is destroyed.
+ *
+ * Example:
+ *   auto blk = appbase::make_reclaimed_shared<block>(std::move(raw)); // freed off the main thread by its last owner
+ *   app().get_channel<channels::blocks>().set_deferred_reclaim(true); // so are the copies published on the channel
+ */
+class reclaimer {
+public:
+   using destroy_fn = void (*)(void*);
+
+   static reclaimer& instance();
+
+   ~reclaimer();
+
+   /// start the reclaiming thread with room for `max_backlog` objects and reset the stats, restarting it if running
+   void start(size_t max_backlog);
+
+   /// destroy every retired object and stop the reclaiming thread
+   void stop();
+
+   bool running() const;
+
+   /// hand `p` to the reclaiming thread which calls `destroy(p)`, or call it now if it cannot be queued
+   void retire(void* p, destroy_fn destroy) noexcept;
+
+   /// wait until the objects retired before the call have been destroyed
+   void flush();
+
+   struct stats {
+      uint64_t deferred       = 0; ///< objects queued for the reclaiming thread
+      uint64_t inline_destroy = 0; ///< objects destroyed by the caller, the backlog being full or the reclaimer stopped
+      uint64_t reclaimed      = 0; ///< objects destroyed by the reclaiming thread
+      size_t   backlog        = 0; ///< objects waiting for destruction
+      size_t   peak_backlog   = 0;
+      uint64_t reclaim_ns     = 0; ///< time spent destroying on the reclaiming thread
+      uint64_t max_reclaim_ns = 0; ///< longest destruction of a single object
+   };
+   stats get_stats() const;
+
+private:
+   reclaimer();
+
+   struct impl;
+   std::unique_ptr<impl> my;
+};
+
+namespace detail {
+   template <typename T>
+   void reclaim_delete(void* p) {
+      delete static_cast<T*>(p);
+   }
+
+   /// deleter handing the object to the reclaimer
+   template <typename T>
+   struct reclaim_deleter {
+      void operator()(T* p) const noexcept {
+         if (p)
+            reclaimer::instance().retire(p, &reclaim_delete<T>);
+      }
+   };
+} // namespace detail
+
+/**
+ * Destroy `obj` on the reclaiming thread, e.g. a message a handler has finished with.
+ * It is moved to the heap to be queued, retire a pointer owning it instead when that matters.
+ */
+template <typename T>
+void reclaim_later(T&& obj) {
+   using value_t = std::decay_t<T>;
+   reclaimer::instance().retire(new value_t(std::forward<T>(obj)), &detail::reclaim_delete<value_t>);
+}
+
+/**
+ * @return a shared_ptr to a new T which is destroyed on the reclaiming thread when its last owner releases it
+ */
+template <typename T, typename... Args>
+std::shared_ptr<T> make_reclaimed_shared(Args&&... args) {
+   return std::shared_ptr<T>(new T(std::forward<Args>(args)...), detail::reclaim_deleter<T>{});
+}
+
+/**
+ * A handler whose captured state is destroyed on the reclaiming thread after it has run, see reclaim_captures()
+ */
+template <typename F>
+class reclaimed_handler {
+public:
+   explicit reclaimed_handler(F&& f) : f_(new F(std::move(f))) {}
+
+   template <typename... Args>
+   decltype(auto) operator()(Args&&... args) {
+      return (*f_)(std::forward<Args>(args)...);
+   }
+
+private:
+   std::unique_ptr<F, detail::reclaim_deleter<F>> f_;
+};
+
+/**
+ * Wrap a handler so that its captures are destroyed on the reclaiming thread, e.g.
+ *   app().executor().post(priority::medium, appbase::reclaim_captures([blk = std::move(blk)]() { apply(*blk); }));
+ */
+template <typename F>
+reclaimed_handler<std::decay_t<F>> reclaim_captures(F&& f) {
+   return reclaimed_handler<std::decay_t<F>>(std::decay_t<F>(std::forward<F>(f)));
+}
+
+} // namespace appbase
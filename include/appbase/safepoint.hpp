@@ -0,0 +1,142 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <atomic>
+
+namespace appbase {
+
+/**
+ * Pauses all participating threads (e.g. the threads of every appbase::thread_pool) at a consistent point,
+ * between two of their handlers, so that the requesting thread can briefly act on state shared with them
+ * (consistent snapshots, checkpoints) without ad hoc flags in every plugin.
+ *
+ * Participants call poll() between units of work; the cost when no pause is requested is a relaxed atomic load.
+ */
+class safepoint {
+public:
+   /**
+    * RAII registration of the current thread as a participant of a safepoint.
+    */
+   class participant {
+   public:
+      explicit participant(safepoint& sp) : sp_(sp) {
+         std::lock_guard<std::mutex> g(sp_.mtx_);
+         ++sp_.participants_;
+         current_ = this;
+      }
+
+      ~participant() {
+         std::lock_guard<std::mutex> g(sp_.mtx_);
+         --sp_.participants_;
+         current_ = nullptr;
+         sp_.parked_cv_.notify_all();
+      }
+
+      participant(const participant&) = delete;
+      participant& operator=(const participant&) = delete;
+
+      /**
+       * Park this thread if a pause has been requested, until the requester resumes participants.
+       */
+      void poll() {
+         if (sp_.requested_.load(std::memory_order_acquire))
+            sp_.park();
+      }
+
+   private:
+      friend class safepoint;
+      safepoint& sp_;
+   };
+
+   /**
+    * Register a function invoked when a pause is requested, used to wake participants that are blocked waiting
+    * for work so they reach their next poll().
+    * @return handle to pass to remove_waker()
+    */
+   auto add_waker(std::function<void()> waker) {
+      std::lock_guard<std::mutex> g(mtx_);
+      return wakers_.insert(wakers_.end(), std::move(waker));
+   }
+
+   void remove_waker(std::list<std::function<void()>>::iterator itr) {
+      std::lock_guard<std::mutex> g(mtx_);
+      wakers_.erase(itr);
+   }
+
+   /**
+    * Pause all participants at their next poll(), run f while they are parked, then resume them.
+    * May be called from a participant thread, which counts as parked while f runs and while it waits for
+    * another call to complete. Concurrent calls are serialized.
+    */
+   template <typename F>
+   decltype(auto) run(F&& f) {
+      // also when a waker, waiting or f throws; locks through `lk`, which may still hold the mutex
+      struct resume {
+         safepoint&                    sp;
+         std::unique_lock<std::mutex>& lk;
+         ~resume() {
+            if (!lk.owns_lock())
+               lk.lock();
+            sp.requested_.store(false, std::memory_order_release);
+            sp.running_ = false;
+            ++sp.generation_;
+            sp.resume_cv_.notify_all();
+            sp.turn_cv_.notify_all();
+         }
+      };
+
+      std::unique_lock<std::mutex> lk(mtx_);
+      const uint32_t self = current_ && &current_->sp_ == this ? 1 : 0;
+      if (running_) {
+         // the running call may be waiting for this thread to park
+         parked_ += self;
+         parked_cv_.notify_all();
+         turn_cv_.wait(lk, [&]() { return !running_; });
+         parked_ -= self;
+      }
+      running_ = true;
+      requested_.store(true, std::memory_order_release);
+      resume r{*this, lk};
+      for (auto& w : wakers_)
+         w();
+      parked_cv_.wait(lk, [&]() { return parked_ + self >= participants_; });
+      lk.unlock();
+      return f();
+   }
+
+   /// number of registered participants
+   uint32_t participants() const {
+      std::lock_guard<std::mutex> g(mtx_);
+      return participants_;
+   }
+
+private:
+   void park() {
+      std::unique_lock<std::mutex> lk(mtx_);
+      if (!requested_.load(std::memory_order_relaxed))
+         return;
+      const uint64_t gen = generation_;
+      ++parked_;
+      parked_cv_.notify_all();
+      resume_cv_.wait(lk, [&]() { return generation_ != gen; });
+      --parked_;
+   }
+
+   mutable std::mutex                   mtx_;
+   std::condition_variable              parked_cv_;
+   std::condition_variable              resume_cv_;
+   std::condition_variable              turn_cv_;   ///< signalled when a run() completes
+   bool                                 running_ = false; ///< a run() is pausing participants or running f
+   std::atomic<bool>                    requested_{false};
+   uint32_t                             participants_ = 0;
+   uint32_t                             parked_ = 0;
+   uint64_t                             generation_ = 0;
+   std::list<std::function<void()>>     wakers_;
+
+   inline static thread_local participant* current_ = nullptr;
+};
+
+} // namespace appbase
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <appbase/channel.hpp>
+#include <appbase/method.hpp>
+
+#include <boost/exception/diagnostic_information.hpp>
+
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+namespace appbase {
+
+/**
+ * Channels and methods whose subscribers and providers are fixed at build time.
+ *
+ * Subscribers and providers are named as template arguments (functions, or static member functions), so a
+ * dispatch is a sequence of direct calls the compiler can inline: no boost::signals2, no type erasure and no
+ * lookup in the application's channel or method maps. The runtime channels and methods of the same declaration
+ * are unaffected and remain available for dynamically registered participants.
+ *
+ * Example:
+ *   using blocks = static_channel<blocks_channel, &net_plugin_on_block, &history_plugin_on_block>;
+ *   blocks::publish(app().executor(), priority::high, block);
+ *
+ *   using compute = static_method<compute_method, &compute_provider>;
+ *   int r = compute::call(21);
+ */
+
+// ------------------------------------------------------------------------------------------
+/**
+ * @tparam ChannelDecl - the @ref channel_decl of the channel, its DispatchPolicy must be @ref drop_exceptions
+ * @tparam Subscribers - callables invoked with `const Data&`, in order
+ */
+template <typename ChannelDecl, auto... Subscribers>
+struct static_channel;
+
+template <typename Tag, typename Data, typename DispatchPolicy, auto... Subscribers>
+struct static_channel<channel_decl<Tag, Data, DispatchPolicy>, Subscribers...> {
+   static_assert(std::is_same_v<DispatchPolicy, drop_exceptions>,
+                 "static_channel only implements the drop_exceptions dispatch policy");
+   static_assert((std::is_invocable_v<decltype(Subscribers), const Data&> && ...),
+                 "static_channel subscribers must be callable with const Data&");
+
+   using data_type = Data;
+
+   /**
+    * Call every subscriber with `data` on this thread, dropping exceptions
+    */
+   static void dispatch(const Data& data) {
+      (call_subscriber<Subscribers>(data), ...);
+   }
+
+   /**
+    * Dispatch a copy of `data` from the priority queue of `exec`, as channel::publish() does
+    */
+   template <typename Executor>
+   static void publish(Executor& exec, int priority, const Data& data) {
+      if constexpr (sizeof...(Subscribers) > 0)
+         exec.post(priority, [data]() { dispatch(data); });
+   }
+
+   static constexpr size_t subscriber_count() { return sizeof...(Subscribers); }
+
+private:
+   template <auto Subscriber>
+   static void call_subscriber(const Data& data) {
+      try {
+         std::invoke(Subscriber, data);
+      } catch (...) {
+         // drop
+      }
+   }
+};
+
+// ------------------------------------------------------------------------------------------
+/**
+ * @tparam MethodDecl - the @ref method_decl of the method, its DispatchPolicy must be @ref first_success_policy
+ *                      or @ref first_provider_policy
+ * @tparam Providers - callables invoked with the method's arguments, in order of precedence
+ */
+template <typename MethodDecl, auto... Providers>
+struct static_method;
+
+template <typename Tag, typename Ret, typename... Args, template <typename> class DispatchPolicy, auto... Providers>
+struct static_method<method_decl<Tag, Ret(Args...), DispatchPolicy>, Providers...> {
+   static_assert(sizeof...(Providers) > 0, "static_method requires at least one provider");
+   static_assert((std::is_invocable_r_v<Ret, decltype(Providers), Args...> && ...),
+                 "static_method providers must be callable with the method's signature");
+
+   using result_type = Ret;
+
+   /**
+    * Call the method: with first_success_policy the providers are tried in order until one does not throw, with
+    * first_provider_policy only the first one is called
+    */
+   static Ret call(Args... args) {
+      if constexpr (std::is_same_v<DispatchPolicy<Ret(Args...)>, first_provider_policy<Ret(Args...)>>) {
+         return call_first<Providers...>(args...);
+      } else {
+         static_assert(std::is_same_v<DispatchPolicy<Ret(Args...)>, first_success_policy<Ret(Args...)>>,
+                       "static_method only implements the first_success_policy and first_provider_policy");
+         std::string err;
+         return try_providers<Providers...>(err, args...);
+      }
+   }
+
+private:
+   template <auto First, auto... Rest>
+   static Ret call_first(Args&... args) {
+      return std::invoke(First, std::forward<Args>(args)...);
+   }
+
+   template <auto First, auto... Rest>
+   static Ret try_providers(std::string& err, Args&... args) {
+      try {
+         if constexpr (sizeof...(Rest) > 0)
+            return std::invoke(First, args...); // later providers may need the arguments, do not move from them
+         else
+            return std::invoke(First, std::forward<Args>(args)...);
+      } catch (...) {
+         if (!err.empty())
+            err += "\",\"";
+         err += boost::current_exception_diagnostic_information();
+      }
+      if constexpr (sizeof...(Rest) > 0)
+         return try_providers<Rest...>(err, args...);
+      else
+         throw std::length_error(std::string("No Result Available, All providers returned exceptions[") + err + "]");
+   }
+};
+
+} // namespace appbase
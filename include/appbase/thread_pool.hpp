@@ -0,0 +1,119 @@
+#pragma once
+
+#include <appbase/memory_residency.hpp>
+#include <appbase/qsbr.hpp>
+#include <appbase/safepoint.hpp>
+
+#include <boost/asio.hpp>
+
+#include <cassert>
+#include <exception>
+#include <functional>
+#include <optional>
+#include <thread>
+#include <vector>
+
+namespace appbase {
+
+/**
+ * A pool of threads running a boost::asio::io_context, managed by appbase so that its threads take part in
+ * app().executor().get_safepoint() pauses between handlers.
+ *
+ * Example:
+ *   appbase::thread_pool pool{app().executor().get_safepoint(), &app().executor().get_qsbr()};
+ *   pool.start(4, [](std::exception_ptr e) { app().executor().post(priority::high, [e]() { std::rethrow_exception(e); }); });
+ *   boost::asio::post(pool.get_executor(), []() { do_work(); });
+ *   ...
+ *   pool.stop(); // e.g. in plugin_shutdown()
+ */
+class thread_pool {
+public:
+   using on_except_t = std::function<void(std::exception_ptr)>;
+
+   /**
+    * @param domain when set, the pool's threads are participants of it announcing a quiescent state between handlers
+    */
+   explicit thread_pool(safepoint& sp, qsbr* domain = nullptr) : sp_(sp), qsbr_(domain) {}
+
+   ~thread_pool() {
+      stop();
+   }
+
+   thread_pool(const thread_pool&) = delete;
+   thread_pool& operator=(const thread_pool&) = delete;
+
+   /**
+    * Spawn `num_threads` threads running the pool's io_context.
+    * @param on_except invoked on the pool thread with any exception escaping a handler; the thread keeps running
+    */
+   void start(size_t num_threads, on_except_t on_except) {
+      assert(threads_.empty());
+      ioc_.restart();
+      work_.emplace(boost::asio::make_work_guard(ioc_));
+      // wake threads blocked waiting for work so they reach safepoint::participant::poll() and
+      // qsbr::participant::quiescent()
+      auto wake = [this, num_threads]() {
+         for (size_t i = 0; i < num_threads; ++i)
+            boost::asio::post(ioc_, []() {});
+      };
+      waker_ = sp_.add_waker(wake);
+      if (qsbr_)
+         qsbr_waker_ = qsbr_->add_waker(wake);
+      for (size_t i = 0; i < num_threads; ++i) {
+         threads_.emplace_back([this, on_except]() {
+            memory_residency::prefault_stack();
+            safepoint::participant sp(sp_);
+            std::optional<qsbr::participant> qp;
+            if (qsbr_)
+               qp.emplace(*qsbr_);
+            while (true) {
+               try {
+                  if (!ioc_.run_one())
+                     break;
+               } catch (...) {
+                  on_except(std::current_exception());
+               }
+               if (qp)
+                  qp->quiescent();
+               sp.poll();
+            }
+         });
+      }
+   }
+
+   /**
+    * Stop the io_context and join all threads. Queued handlers which have not started are not executed.
+    */
+   void stop() {
+      if (threads_.empty())
+         return;
+      work_.reset();
+      ioc_.stop();
+      for (auto& t : threads_)
+         t.join();
+      threads_.clear();
+      sp_.remove_waker(*waker_);
+      waker_.reset();
+      if (qsbr_waker_) {
+         qsbr_->remove_waker(*qsbr_waker_);
+         qsbr_waker_.reset();
+      }
+   }
+
+   boost::asio::io_context& get_io_context() { return ioc_; }
+
+   auto get_executor() { return ioc_.get_executor(); }
+
+   size_t size() const { return threads_.size(); }
+
+private:
+   safepoint&                  sp_;
+   qsbr*                       qsbr_;
+   boost::asio::io_context     ioc_;
+   std::optional<boost::asio::executor_work_guard<boost::asio::io_context::executor_type>> work_;
+   std::optional<std::list<std::function<void()>>::iterator> waker_;
+   std::optional<std::list<std::function<void()>>::iterator> qsbr_waker_;
+   std::vector<std::thread>    threads_;
+};
+
+} // namespace appbase
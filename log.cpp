@@ -0,0 +1,347 @@
+#include <appbase/log.hpp>
+#include <appbase/memory_residency.hpp>
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+namespace appbase {
+
+const char* to_string(log_level level) {
+   switch (level) {
+      case log_level::debug: return "debug";
+      case log_level::info:  return "info";
+      case log_level::warn:  return "warn";
+      case log_level::error: return "error";
+      case log_level::off:   return "off";
+   }
+   return "unknown";
+}
+
+std::optional<log_level> log_level_from_string(std::string_view name) {
+   for (auto level : {log_level::debug, log_level::info, log_level::warn, log_level::error, log_level::off})
+      if (name == to_string(level))
+         return level;
+   return {};
+}
+
+namespace detail {
+   log_buffer::log_buffer(size_t capacity, uint32_t thread_index)
+      : thread_index(thread_index)
+      , capacity_(memory_residency::region_size(
+           std::max<size_t>(1024, size_t(1) << (64 - __builtin_clzll(std::max<size_t>(capacity, 2) - 1)))))
+      , data_(static_cast<std::byte*>(memory_residency::allocate_region(capacity_))) {}
+
+   log_buffer::~log_buffer() {
+      memory_residency::deallocate_region(data_, capacity_);
+   }
+} // namespace detail
+
+namespace {
+   struct logger_registry {
+      std::mutex                                                   mtx;
+      std::map<std::string, std::unique_ptr<logger>, std::less<>> loggers;
+      log_level                                                    level = log_level::info;
+      std::map<std::string, log_level, std::less<>>                levels;
+
+      log_level level_of(std::string_view name) const {
+         auto itr = levels.find(name);
+         return itr != levels.end() ? itr->second : level;
+      }
+   };
+
+   logger_registry& registry() {
+      static logger_registry r;
+      return r;
+   }
+
+   // closes the thread's buffer when the thread exits, the logging thread releases it once drained
+   struct thread_buffer_holder {
+      std::shared_ptr<detail::log_buffer> buffer;
+      ~thread_buffer_holder() {
+         if (buffer)
+            buffer->closed.store(true, std::memory_order_release);
+      }
+   };
+   thread_local thread_buffer_holder tl_buffer;
+
+   // how often the logging thread remeasures fast_clock::system_offset_ns()
+   constexpr int64_t system_offset_refresh_ns = 1'000'000'000;
+
+   void format_record(std::ostream& os, const detail::log_record& rec, void* args, uint32_t thread_index,
+                      int64_t system_offset_ns) {
+      const int64_t     ns   = rec.time_ns + system_offset_ns;
+      const std::time_t secs = ns / 1'000'000'000;
+      std::tm           tm{};
+      gmtime_r(&secs, &tm);
+      char ts[32];
+      std::strftime(ts, sizeof(ts), "%Y-%m-%dT%H:%M:%S", &tm);
+      char us[16];
+      std::snprintf(us, sizeof(us), ".%06dZ", static_cast<int>(ns % 1'000'000'000 / 1000));
+
+      const char* file = std::strrchr(rec.file, '/');
+      file             = file ? file + 1 : rec.file;
+
+      os << ts << us << ' ' << to_string(rec.level) << " #" << thread_index << ' ' << rec.source->name() << ' '
+         << file << ':' << rec.line << "] ";
+      try {
+         rec.format(os, rec.fmt, args);
+      } catch (...) {
+         os << "<log format error>";
+      }
+      os << '\n';
+   }
+} // namespace
+
+logger& get_logger(std::string_view name) {
+   auto&            reg = registry();
+   std::lock_guard  g(reg.mtx);
+   auto             itr = reg.loggers.find(name);
+   if (itr == reg.loggers.end())
+      itr = reg.loggers.emplace(std::string(name), std::make_unique<logger>(std::string(name), reg.level_of(name))).first;
+   return *itr->second;
+}
+
+// ------------------------------------------------------------------------------------------
+struct log_backend::impl {
+   std::mutex                                       mtx; // all but the logging thread's state below
+   std::condition_variable                          cv;
+   log_config                                       config;
+   std::vector<std::shared_ptr<detail::log_buffer>> buffers;
+   uint32_t                                         next_thread_index = 0;
+   uint64_t                                         retired_dropped   = 0; ///< dropped by released buffers
+   std::thread                                      thread;
+   bool                                             stopping        = false;
+   bool                                             woken           = false; ///< by a record, see log_backend::wake()
+   uint64_t                                         flush_requested = 0;
+   uint64_t                                         flush_done      = 0;
+   std::mutex                                       direct_mtx; ///< write_now() to std::cerr
+
+   // logging thread
+   struct line {
+      int64_t     time_ns;
+      std::string text;
+   };
+   std::ofstream      file;
+   uint64_t           file_size        = 0;
+   uint64_t           reported_dropped = 0;
+   int64_t            system_offset_ns = 0;
+   int64_t            offset_measured  = 0; ///< fast_clock nanoseconds when system_offset_ns was measured, 0 if never
+   std::ostringstream fmt;
+   std::vector<line>  lines;
+
+   void run(std::atomic<bool>& waiting) {
+      std::unique_lock g(mtx);
+      while (true) {
+         const bool     stop   = stopping;
+         const uint64_t target = flush_requested;
+         auto           bufs   = buffers;
+         g.unlock();
+
+         const size_t n = drain(bufs);
+
+         g.lock();
+         auto released = std::remove_if(buffers.begin(), buffers.end(), [&](const auto& b) {
+            return b->closed.load(std::memory_order_acquire) && b->empty();
+         });
+         for (auto itr = released; itr != buffers.end(); ++itr)
+            retired_dropped += (*itr)->dropped.load(std::memory_order_relaxed);
+         buffers.erase(released, buffers.end());
+         if (flush_done != target) {
+            flush_done = target;
+            cv.notify_all();
+         }
+         if (stop)
+            break;
+         if (n == 0) {
+            // a producer committing to a drained buffer either sees `waiting` and wakes this thread, or its record
+            // is seen by the check below
+            waiting.store(true, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (std::all_of(buffers.begin(), buffers.end(), [](const auto& b) { return b->empty(); }))
+               cv.wait(g, [&]() { return stopping || flush_requested != target || woken; });
+            woken = false;
+            waiting.store(false, std::memory_order_relaxed);
+         }
+      }
+   }
+
+   size_t drain(const std::vector<std::shared_ptr<detail::log_buffer>>& bufs) {
+      size_t   n       = 0;
+      uint64_t dropped = 0;
+      const int64_t now = fast_clock::now().time_since_epoch().count();
+      if (!offset_measured || now - offset_measured >= system_offset_refresh_ns) {
+         system_offset_ns = fast_clock::system_offset_ns();
+         offset_measured  = now;
+      }
+      for (const auto& b : bufs) {
+         n += b->consume([&](const detail::log_record& rec, void* args) {
+            fmt.str({});
+            format_record(fmt, rec, args, b->thread_index, system_offset_ns);
+            lines.push_back({rec.time_ns, fmt.str()});
+         });
+         dropped += b->dropped.load(std::memory_order_relaxed);
+      }
+
+      // records of different threads are merged in time order
+      std::stable_sort(lines.begin(), lines.end(), [](const line& a, const line& b) { return a.time_ns < b.time_ns; });
+      for (const auto& l : lines)
+         write(l.text);
+      lines.clear();
+
+      {
+         std::lock_guard g(mtx);
+         dropped += retired_dropped;
+      }
+      if (dropped > reported_dropped) {
+         write("appbase: " + std::to_string(dropped - reported_dropped) + " log records dropped, thread buffers full\n");
+         reported_dropped = dropped;
+      }
+
+      if (file.is_open())
+         file.flush();
+      else if (n)
+         std::cerr.flush();
+      return n;
+   }
+
+   void write(const std::string& text) {
+      if (!file.is_open()) {
+         std::cerr << text;
+         return;
+      }
+      if (file_size && file_size + text.size() > config.rotate_size)
+         rotate();
+      file << text;
+      file_size += text.size();
+   }
+
+   void open_file() {
+      std::error_code ec;
+      if (config.file.has_parent_path())
+         std::filesystem::create_directories(config.file.parent_path(), ec);
+      file.open(config.file, std::ios::app);
+      file_size = file.is_open() ? std::filesystem::file_size(config.file, ec) : 0;
+      if (ec)
+         file_size = 0;
+      if (!file.is_open())
+         std::cerr << "appbase: unable to open log file " << config.file << ", logging to stderr\n";
+   }
+
+   void rotate() {
+      file.close();
+      std::error_code ec;
+      auto            rotated = [&](uint32_t i) { return std::filesystem::path(config.file.string() + "." + std::to_string(i)); };
+      if (config.rotate_count == 0) {
+         std::filesystem::remove(config.file, ec);
+      } else {
+         std::filesystem::remove(rotated(config.rotate_count), ec);
+         for (uint32_t i = config.rotate_count; i > 1; --i)
+            std::filesystem::rename(rotated(i - 1), rotated(i), ec);
+         std::filesystem::rename(config.file, rotated(1), ec);
+      }
+      open_file();
+   }
+};
+
+log_backend& log_backend::instance() {
+   static log_backend backend;
+   return backend;
+}
+
+log_backend::log_backend() : my(new impl()) {}
+
+log_backend::~log_backend() {
+   stop();
+}
+
+void log_backend::start(log_config config) {
+   stop();
+   {
+      auto&           reg = registry();
+      std::lock_guard g(reg.mtx);
+      reg.level  = config.level;
+      reg.levels = config.levels;
+      for (auto& [name, l] : reg.loggers)
+         l->set_level(reg.level_of(name));
+   }
+   std::lock_guard g(my->mtx);
+   my->config   = std::move(config);
+   my->stopping = false;
+   if (!my->config.file.empty())
+      my->open_file();
+   my->thread = std::thread([this]() { my->run(waiting_); });
+   running_.store(true, std::memory_order_release);
+}
+
+void log_backend::stop() {
+   {
+      std::lock_guard g(my->mtx);
+      if (!my->thread.joinable())
+         return;
+      running_.store(false, std::memory_order_release);
+      my->stopping = true;
+   }
+   my->cv.notify_all();
+   my->thread.join();
+
+   // records committed by threads which saw the backend running after the logging thread's last drain
+   std::vector<std::shared_ptr<detail::log_buffer>> bufs;
+   {
+      std::lock_guard g(my->mtx);
+      bufs = my->buffers;
+   }
+   my->drain(bufs);
+   if (my->file.is_open())
+      my->file.close();
+}
+
+void log_backend::wake() {
+   {
+      std::lock_guard g(my->mtx);
+      my->woken = true;
+   }
+   my->cv.notify_all();
+}
+
+void log_backend::flush() {
+   std::unique_lock g(my->mtx);
+   if (!my->thread.joinable() || my->stopping)
+      return;
+   const uint64_t target = ++my->flush_requested;
+   my->cv.notify_all();
+   my->cv.wait(g, [&]() { return my->flush_done >= target || my->stopping; });
+}
+
+uint64_t log_backend::dropped() const {
+   std::lock_guard g(my->mtx);
+   uint64_t        n = my->retired_dropped;
+   for (const auto& b : my->buffers)
+      n += b->dropped.load(std::memory_order_relaxed);
+   return n;
+}
+
+detail::log_buffer& log_backend::thread_buffer() {
+   if (!tl_buffer.buffer) {
+      std::lock_guard g(my->mtx);
+      tl_buffer.buffer = std::make_shared<detail::log_buffer>(my->config.buffer_size, my->next_thread_index++);
+      my->buffers.push_back(tl_buffer.buffer);
+   }
+   return *tl_buffer.buffer;
+}
+
+void log_backend::write_now(const detail::log_record& rec, void* args) {
+   std::ostringstream os;
+   format_record(os, rec, args, tl_buffer.buffer ? tl_buffer.buffer->thread_index : 0, fast_clock::system_offset_ns());
+   std::lock_guard g(my->direct_mtx);
+   std::cerr << os.str() << std::flush;
+}
+
+} // namespace appbase
@@ -0,0 +1,256 @@
+#include <appbase/memory_pressure.hpp>
+#include <appbase/log.hpp>
+
+#include <algorithm>
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+namespace appbase {
+
+namespace {
+   // shrinking releases down to this fraction of a threshold, so that a shrink is not posted again at once
+   constexpr double hysteresis = 0.9;
+
+   std::string read_file(const std::string& path) {
+      std::ifstream      in(path);
+      std::ostringstream os;
+      os << in.rdbuf();
+      return in ? os.str() : std::string();
+   }
+
+   uint64_t read_number(const std::string& path) {
+      const std::string text = read_file(path);
+      return text.empty() || text.compare(0, 3, "max") == 0 ? 0 : std::strtoull(text.c_str(), nullptr, 10);
+   }
+
+   /// value of `key` in a file of "key value" lines such as memory.stat, 0 if unavailable
+   uint64_t read_stat(const std::string& path, const std::string& key) {
+      std::istringstream in(read_file(path));
+      std::string        name;
+      uint64_t           value = 0;
+      while (in >> name >> value)
+         if (name == key)
+            return value;
+      return 0;
+   }
+
+   /// `some avg10=` of a PSI file, -1 if unavailable
+   double read_psi_some_avg10(const std::string& path) {
+      const std::string text = read_file(path);
+      const auto        pos  = text.find("some avg10=");
+      return pos == std::string::npos ? -1 : std::strtod(text.c_str() + pos + 11, nullptr);
+   }
+
+   /// directory of the process's cgroup v2, empty if not under cgroup v2
+   const std::string& cgroup_dir() {
+      static const std::string dir = []() {
+         std::istringstream in(read_file("/proc/self/cgroup"));
+         for (std::string line; std::getline(in, line);)
+            if (line.compare(0, 3, "0::") == 0)
+               return "/sys/fs/cgroup" + line.substr(3);
+         return std::string();
+      }();
+      return dir;
+   }
+} // namespace
+
+struct memory_pressure::impl {
+   struct shrinker {
+      uint64_t    id;
+      int         order;
+      std::string name;
+      shrink_fn   fn;
+   };
+
+   explicit impl(post_fn post) : post(std::move(post)) {}
+
+   post_fn                 post;
+   mutable std::mutex      mtx;
+   std::condition_variable cv;
+   std::vector<shrinker>   shrinkers; ///< in decreasing order
+   uint64_t                next_id = 1;
+   std::function<sample()> sampler = &memory_pressure::read_sample;
+   config                  cfg;
+   std::thread             thread;
+   bool                    stopping = false;
+   std::atomic<bool>       in_flight{false}; ///< a posted shrink has not run yet
+   stats                   st;
+
+   void run(memory_pressure& mp) {
+      std::unique_lock g(mtx);
+      uint64_t last_target = 0; // of the last shrink posted
+      unsigned backoff     = 0; // samples skipped after the last shrink which did not help
+      unsigned skip        = 0;
+      bool     retry       = false; // the wait after a shrink which did not help is over
+      while (!cv.wait_for(g, cfg.interval, [&]() { return stopping; })) {
+         auto sample_fn = sampler;
+         g.unlock();
+         const sample s      = sample_fn();
+         const uint64_t target = target_for(s, cfg);
+         g.lock();
+         st.last = s;
+         if (!target) {
+            last_target = backoff = skip = 0;
+            retry       = false;
+            continue;
+         }
+         if (in_flight.load())
+            continue;
+         if (skip) {
+            --skip;
+            ++st.skipped;
+            continue;
+         }
+         if (target < last_target) {
+            backoff = 0;
+         } else if (last_target && !retry) {
+            backoff = std::min(backoff ? backoff * 2 : 1, max_backoff);
+            skip    = backoff - 1;
+            retry   = true;
+            ++st.skipped;
+            continue;
+         }
+         retry       = false;
+         last_target = target;
+         in_flight.store(true);
+         APPBASE_WLOG(get_logger("appbase"), "memory pressure: rss {} MiB, cgroup {} of {} MiB, psi some avg10 {}, "
+                      "releasing {} MiB", s.rss >> 20, s.cgroup_current >> 20, s.cgroup_max >> 20, s.psi_some_avg10,
+                      target >> 20);
+         post(cfg.priority, [&mp, target]() {
+            struct done {
+               std::atomic<bool>& in_flight;
+               ~done() { in_flight.store(false); }
+            } d{mp.my->in_flight};
+            mp.shrink(target);
+         });
+      }
+   }
+};
+
+memory_pressure::handle& memory_pressure::handle::operator=(handle&& o) noexcept {
+   if (this != &o) {
+      reset();
+      mp_   = o.mp_;
+      id_   = o.id_;
+      o.mp_ = nullptr;
+   }
+   return *this;
+}
+
+void memory_pressure::handle::reset() {
+   if (!mp_)
+      return;
+   std::lock_guard g(mp_->my->mtx);
+   auto&           v = mp_->my->shrinkers;
+   v.erase(std::remove_if(v.begin(), v.end(), [&](const auto& s) { return s.id == id_; }), v.end());
+   mp_ = nullptr;
+}
+
+memory_pressure::memory_pressure(post_fn post) : my(new impl(std::move(post))) {}
+
+memory_pressure::~memory_pressure() {
+   stop();
+}
+
+memory_pressure::handle memory_pressure::add_shrinker(int order, std::string name, shrink_fn fn) {
+   std::lock_guard g(my->mtx);
+   auto&           v   = my->shrinkers;
+   auto            pos = std::upper_bound(v.begin(), v.end(), order, [](int o, const auto& s) { return o > s.order; });
+   const uint64_t  id  = my->next_id++;
+   v.insert(pos, {id, order, std::move(name), std::move(fn)});
+   return handle(this, id);
+}
+
+void memory_pressure::start(config cfg) {
+   stop();
+   std::lock_guard g(my->mtx);
+   my->cfg      = cfg;
+   my->stopping = false;
+   if (cfg.interval.count() > 0 && (cfg.rss_limit || cfg.cgroup_percent > 0 || cfg.psi_avg10 > 0))
+      my->thread = std::thread([this]() { my->run(*this); });
+}
+
+void memory_pressure::stop() {
+   {
+      std::lock_guard g(my->mtx);
+      if (!my->thread.joinable())
+         return;
+      my->stopping = true;
+   }
+   my->cv.notify_all();
+   my->thread.join();
+}
+
+void memory_pressure::set_sampler(std::function<sample()> sampler) {
+   std::lock_guard g(my->mtx);
+   my->sampler = std::move(sampler);
+}
+
+memory_pressure::sample memory_pressure::read_sample() {
+   sample s;
+   std::istringstream statm(read_file("/proc/self/statm"));
+   uint64_t           size = 0, resident = 0;
+   if (statm >> size >> resident)
+      s.rss = resident * uint64_t(::sysconf(_SC_PAGESIZE));
+
+   double psi = -1;
+   if (const auto& dir = cgroup_dir(); !dir.empty()) {
+      // page cache which can be reclaimed without writeback is not memory the process needs released
+      const uint64_t current = read_number(dir + "/memory.current");
+      const uint64_t inactive_file = read_stat(dir + "/memory.stat", "inactive_file");
+      s.cgroup_current = current > inactive_file ? current - inactive_file : 0;
+      s.cgroup_max     = read_number(dir + "/memory.max");
+      psi              = read_psi_some_avg10(dir + "/memory.pressure");
+   }
+   if (psi < 0)
+      psi = read_psi_some_avg10("/proc/pressure/memory");
+   s.psi_some_avg10 = std::max(psi, 0.0);
+   return s;
+}
+
+uint64_t memory_pressure::target_for(const sample& s, const config& cfg) {
+   uint64_t target = 0;
+   if (cfg.rss_limit && s.rss > cfg.rss_limit)
+      target = std::max(target, s.rss - uint64_t(cfg.rss_limit * hysteresis));
+   if (cfg.cgroup_percent > 0 && s.cgroup_max) {
+      const double threshold = s.cgroup_max * cfg.cgroup_percent / 100;
+      if (s.cgroup_current > threshold)
+         target = std::max(target, s.cgroup_current - uint64_t(threshold * hysteresis));
+   }
+   if (cfg.psi_avg10 > 0 && s.psi_some_avg10 > cfg.psi_avg10)
+      target = std::max(target, uint64_t(s.rss * cfg.psi_release / 100));
+   return target;
+}
+
+size_t memory_pressure::shrink(size_t target) {
+   std::vector<impl::shrinker> shrinkers;
+   {
+      std::lock_guard g(my->mtx);
+      shrinkers = my->shrinkers;
+   }
+   size_t released = 0;
+   for (auto& s : shrinkers) {
+      if (released >= target)
+         break;
+      const size_t n = s.fn(target - released);
+      APPBASE_DLOG(get_logger("appbase"), "memory pressure: {} released {} KiB", s.name, n >> 10);
+      released += n;
+   }
+   std::lock_guard g(my->mtx);
+   ++my->st.events;
+   my->st.released += released;
+   return released;
+}
+
+memory_pressure::stats memory_pressure::get_stats() const {
+   std::lock_guard g(my->mtx);
+   return my->st;
+}
+
+} // namespace appbase
@@ -0,0 +1,156 @@
+#include <appbase/memory_residency.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <new>
+
+#include <sys/mman.h>
+#include <alloca.h>
+#include <pthread.h>
+
+namespace appbase {
+
+namespace {
+   std::atomic<hugepage_mode> g_mode{hugepage_mode::off};
+   std::atomic<size_t>        g_stack_prefault{0};
+   std::atomic<size_t>        g_region_bytes{0};
+   std::atomic<size_t>        g_hugetlb_bytes{0};
+   std::atomic<uint64_t>      g_fallbacks{0};
+
+   size_t round_up(size_t n, size_t to) { return (n + to - 1) / to * to; }
+
+   void* map_aligned_hugepage_region(size_t size) {
+      // over-allocate so that a 2MiB aligned range can be kept, transparent hugepages need the alignment
+      const size_t span = size + memory_residency::hugepage_size;
+      void* p = ::mmap(nullptr, span, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (p == MAP_FAILED)
+         return nullptr;
+      const auto base    = reinterpret_cast<uintptr_t>(p);
+      const auto aligned = round_up(base, memory_residency::hugepage_size);
+      if (aligned > base)
+         ::munmap(p, aligned - base);
+      if (const size_t tail = base + span - (aligned + size))
+         ::munmap(reinterpret_cast<void*>(aligned + size), tail);
+#ifdef MADV_HUGEPAGE
+      ::madvise(reinterpret_cast<void*>(aligned), size, MADV_HUGEPAGE);
+#endif
+      return reinterpret_cast<void*>(aligned);
+   }
+} // namespace
+
+const char* to_string(hugepage_mode mode) {
+   switch (mode) {
+      case hugepage_mode::off:         return "off";
+      case hugepage_mode::transparent: return "transparent";
+      case hugepage_mode::hugetlb:     return "explicit";
+   }
+   return "unknown";
+}
+
+std::optional<hugepage_mode> hugepage_mode_from_string(std::string_view name) {
+   for (auto mode : {hugepage_mode::off, hugepage_mode::transparent, hugepage_mode::hugetlb})
+      if (name == to_string(mode))
+         return mode;
+   return {};
+}
+
+void memory_residency::set_hugepages(hugepage_mode mode) {
+   g_mode.store(mode, std::memory_order_relaxed);
+}
+
+hugepage_mode memory_residency::hugepages() {
+   return g_mode.load(std::memory_order_relaxed);
+}
+
+size_t memory_residency::region_size(size_t size) {
+   return hugepages() == hugepage_mode::off ? size : round_up(size, hugepage_size);
+}
+
+void* memory_residency::allocate_region(size_t size) {
+   void* p = nullptr;
+   switch (hugepages()) {
+      case hugepage_mode::hugetlb:
+         // sizes which are not a multiple of the hugepage size are not attempted, so do not count as fallbacks
+         if (size % hugepage_size == 0) {
+#ifdef MAP_HUGETLB
+            p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (p != MAP_FAILED) {
+               g_hugetlb_bytes += size;
+               break;
+            }
+#endif
+            g_fallbacks.fetch_add(1, std::memory_order_relaxed);
+         }
+         [[fallthrough]];
+      case hugepage_mode::transparent:
+         p = size % hugepage_size == 0 ? map_aligned_hugepage_region(size) : nullptr;
+         if (p)
+            break;
+         [[fallthrough]];
+      case hugepage_mode::off:
+         p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+         if (p == MAP_FAILED)
+            throw std::bad_alloc();
+         break;
+   }
+   g_region_bytes += size;
+   return p;
+}
+
+void memory_residency::deallocate_region(void* p, size_t size) noexcept {
+   if (!p)
+      return;
+   ::munmap(p, size);
+   g_region_bytes -= size;
+}
+
+std::string memory_residency::lock_all() {
+   if (::mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+      return std::strerror(errno);
+   return {};
+}
+
+void memory_residency::set_stack_prefault(size_t bytes) {
+   g_stack_prefault.store(bytes, std::memory_order_relaxed);
+}
+
+size_t memory_residency::stack_prefault() {
+   return g_stack_prefault.load(std::memory_order_relaxed);
+}
+
+size_t memory_residency::prefault_stack() {
+   size_t bytes = stack_prefault();
+   if (!bytes)
+      return 0;
+   // bounded by the room left below the current frame on the thread's actual stack, keeping some for the caller's
+   // future calls; for the main thread glibc derives the stack from RLIMIT_STACK and the neighbouring mappings
+   constexpr size_t margin = 256 * 1024;
+   pthread_attr_t   attr;
+   if (::pthread_getattr_np(::pthread_self(), &attr) != 0)
+      return 0;
+   void*  stack_addr = nullptr;
+   size_t stack_size = 0;
+   const int rc      = ::pthread_attr_getstack(&attr, &stack_addr, &stack_size);
+   ::pthread_attr_destroy(&attr);
+   if (rc != 0)
+      return 0;
+   const char   here = 0;
+   const size_t room = size_t(&here - static_cast<const char*>(stack_addr));
+   bytes = room > margin ? std::min(bytes, room - margin) : 0;
+   if (!bytes)
+      return 0;
+
+   // touched from the top down, in the order the stack grows
+   volatile char* p = static_cast<char*>(alloca(bytes));
+   for (size_t i = bytes; i > 0; i -= std::min<size_t>(i, 4096))
+      p[i - 1] = 0;
+   return bytes;
+}
+
+memory_residency::stats memory_residency::get_stats() {
+   return {g_region_bytes.load(), g_hugetlb_bytes.load(), g_fallbacks.load()};
+}
+
+} // namespace appbase
@@ -0,0 +1,295 @@
+#include <appbase/profiler.hpp>
+#include <appbase/log.hpp>
+
+#include <boost/core/demangle.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#ifdef __linux__
+#include <csignal>
+#include <ctime>
+#include <dlfcn.h>
+#include <execinfo.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace appbase {
+
+namespace {
+   constexpr size_t max_depth = 64;
+
+   // the signal handler and the sigreturn trampoline
+   constexpr int skipped_frames = 2;
+
+   // how often the samples are moved from the ring to the aggregated profile
+   constexpr std::chrono::milliseconds drain_interval{500};
+} // namespace
+
+struct profiler::impl {
+   struct sample {
+      execution_priority_queue::queue_tag tag;
+      int                                 depth;
+      uint32_t                            weight; ///< timer expirations, several when signals were coalesced
+      const char*                         label;
+      void*                               pcs[max_depth];
+   };
+
+   struct stack_key {
+      execution_priority_queue::queue_tag tag;
+      const char*                         label;
+      std::vector<void*>                  pcs; ///< innermost first
+
+      friend bool operator<(const stack_key& a, const stack_key& b) {
+         return std::tie(a.tag, a.label, a.pcs) < std::tie(b.tag, b.label, b.pcs);
+      }
+   };
+
+   // state shared with the signal handler
+   std::unique_ptr<sample[]> ring;
+   size_t                    capacity = 0; ///< a power of 2
+   std::atomic<uint64_t>     head{0};      ///< written by the signal handler
+   std::atomic<uint64_t>     tail{0};      ///< written by drain()
+   std::atomic<uint64_t>     dropped{0};
+
+   inline static std::atomic<impl*> active{nullptr};
+   inline static std::atomic<int>   in_handler{0};
+
+   mutable std::mutex                       mtx; ///< protects the members below and drain()
+   std::condition_variable                  cv;
+   std::map<stack_key, uint64_t>            profile;
+   std::unordered_map<const void*, std::string> symbols;
+   uint64_t                                 samples = 0;
+   std::thread                              drainer;
+   bool                                     stopping = false;
+#ifdef __linux__
+   timer_t                                  timer{};
+   struct sigaction                         previous{};
+#endif
+   bool                                     timer_armed = false;
+
+#ifdef __linux__
+   static void on_signal(int, siginfo_t* info, void*) {
+      const int saved_errno = errno;
+      in_handler.fetch_add(1);
+      if (impl* p = active.load()) {
+         const uint64_t h = p->head.load(std::memory_order_relaxed);
+         if (h - p->tail.load(std::memory_order_acquire) >= p->capacity) {
+            p->dropped.fetch_add(1, std::memory_order_relaxed);
+         } else {
+            sample& s = p->ring[h & (p->capacity - 1)];
+            s.depth   = ::backtrace(s.pcs, max_depth);
+            s.weight  = 1 + uint32_t(std::max(info->si_overrun, 0));
+            s.tag     = execution_priority_queue::current_tag();
+            s.label   = execution_priority_queue::current_handler_label();
+            p->head.store(h + 1, std::memory_order_release);
+         }
+      }
+      in_handler.fetch_sub(1);
+      errno = saved_errno;
+   }
+#endif
+
+   /// move the samples of the ring into the profile, mtx held
+   void drain() {
+      const uint64_t h = head.load(std::memory_order_acquire);
+      uint64_t       t = tail.load(std::memory_order_relaxed);
+      for (; t != h; ++t) {
+         const sample& s = ring[t & (capacity - 1)];
+         stack_key     key{s.tag, s.label, {}};
+         if (s.depth > skipped_frames)
+            key.pcs.assign(s.pcs + skipped_frames, s.pcs + s.depth);
+         profile[std::move(key)] += s.weight;
+         samples += s.weight;
+      }
+      tail.store(t, std::memory_order_release);
+   }
+
+   void run_drainer() {
+      std::unique_lock g(mtx);
+      while (!cv.wait_for(g, drain_interval, [&]() { return stopping; }))
+         drain();
+   }
+
+   /// name of the function containing `pc`, mtx held
+   const std::string& symbol(const void* pc) {
+      auto itr = symbols.find(pc);
+      if (itr != symbols.end())
+         return itr->second;
+      std::string name;
+#ifdef __linux__
+      Dl_info info{};
+      if (::dladdr(pc, &info) && info.dli_sname) {
+         name = boost::core::demangle(info.dli_sname);
+      } else if (info.dli_fname) {
+         const std::string module = info.dli_fname;
+         char              offset[32];
+         std::snprintf(offset, sizeof(offset), "+0x%zx", size_t(static_cast<const char*>(pc) -
+                                                                static_cast<const char*>(info.dli_fbase)));
+         name = module.substr(module.find_last_of('/') + 1) + offset;
+      }
+#endif
+      if (name.empty()) {
+         char addr[32];
+         std::snprintf(addr, sizeof(addr), "%p", pc);
+         name = addr;
+      }
+      // ';' separates frames in the folded format
+      std::replace(name.begin(), name.end(), ';', ':');
+      return symbols.emplace(pc, std::move(name)).first->second;
+   }
+};
+
+profiler& profiler::instance() {
+   static profiler p;
+   return p;
+}
+
+profiler::profiler() : my(new impl) {}
+
+profiler::~profiler() {
+   stop();
+}
+
+bool profiler::start(config cfg) {
+   stop();
+#ifdef __linux__
+   if (!cfg.hz)
+      return false;
+   {
+      std::lock_guard g(my->mtx);
+      size_t capacity = 1;
+      while (capacity < std::max<size_t>(cfg.ring_size, 2))
+         capacity <<= 1;
+      if (capacity != my->capacity) {
+         if (my->ring)
+            my->drain();
+         my->ring.reset(new impl::sample[capacity]);
+         my->capacity = capacity;
+         my->head     = 0;
+         my->tail     = 0;
+      }
+   }
+
+   // the first call of backtrace() loads the unwinder, which is not async-signal-safe
+   void* warmup[1];
+   ::backtrace(warmup, 1);
+
+   struct sigaction action{};
+   action.sa_sigaction = &impl::on_signal;
+   action.sa_flags     = SA_SIGINFO | SA_RESTART;
+   sigemptyset(&action.sa_mask);
+   if (::sigaction(SIGPROF, &action, &my->previous) != 0) {
+      APPBASE_WLOG(get_logger("appbase"), "profiler: cannot install the SIGPROF handler, errno {}", errno);
+      return false;
+   }
+
+   struct sigevent sev{};
+   sev.sigev_notify           = SIGEV_THREAD_ID;
+   sev.sigev_signo            = SIGPROF;
+#ifdef sigev_notify_thread_id
+   sev.sigev_notify_thread_id = pid_t(::syscall(SYS_gettid));
+#else
+   sev._sigev_un._tid         = pid_t(::syscall(SYS_gettid));
+#endif
+   if (::timer_create(CLOCK_THREAD_CPUTIME_ID, &sev, &my->timer) != 0) {
+      APPBASE_WLOG(get_logger("appbase"), "profiler: cannot create a thread CPU time timer, errno {}", errno);
+      ::sigaction(SIGPROF, &my->previous, nullptr);
+      return false;
+   }
+   my->timer_armed = true;
+   impl::active.store(my.get());
+
+   const long        period_ns = 1000000000L / std::min(cfg.hz, 1000000000u);
+   struct itimerspec spec{};
+   spec.it_interval.tv_sec  = period_ns / 1000000000L;
+   spec.it_interval.tv_nsec = period_ns % 1000000000L;
+   spec.it_value            = spec.it_interval;
+   ::timer_settime(my->timer, 0, &spec, nullptr);
+
+   std::lock_guard g(my->mtx);
+   my->stopping = false;
+   my->drainer  = std::thread([this]() { my->run_drainer(); });
+   return true;
+#else
+   APPBASE_WLOG(get_logger("appbase"), "profiler: not supported on this platform");
+   return false;
+#endif
+}
+
+void profiler::stop() {
+#ifdef __linux__
+   if (!my->timer_armed)
+      return;
+   ::timer_delete(my->timer);
+   my->timer_armed = false;
+   impl::active.store(nullptr);
+   // a signal delivered before the timer was deleted may still be handled
+   while (impl::in_handler.load())
+      std::this_thread::yield();
+   ::sigaction(SIGPROF, &my->previous, nullptr);
+#endif
+   {
+      std::lock_guard g(my->mtx);
+      my->stopping = true;
+   }
+   my->cv.notify_all();
+   if (my->drainer.joinable())
+      my->drainer.join();
+}
+
+bool profiler::running() const {
+   return impl::active.load() == my.get();
+}
+
+void profiler::write_folded(std::ostream& os, const tag_name_fn& tag_name) {
+   std::lock_guard g(my->mtx);
+   if (my->ring)
+      my->drain();
+   std::map<execution_priority_queue::queue_tag, std::string> tags;
+   std::unordered_map<const char*, std::string>                labels;
+   for (const auto& [key, count] : my->profile) {
+      auto tag = tags.find(key.tag);
+      if (tag == tags.end()) {
+         std::string name = tag_name ? tag_name(key.tag) : std::string();
+         tag = tags.emplace(key.tag, name.empty() ? "[no plugin]" : std::move(name)).first;
+      }
+      auto label = labels.find(key.label);
+      if (label == labels.end()) {
+         std::string name = key.label ? boost::core::demangle(key.label) : "[no handler]";
+         std::replace(name.begin(), name.end(), ';', ':');
+         label = labels.emplace(key.label, std::move(name)).first;
+      }
+      os << tag->second << ';' << label->second;
+      for (auto pc = key.pcs.rbegin(); pc != key.pcs.rend(); ++pc)
+         os << ';' << my->symbol(*pc);
+      os << ' ' << count << '\n';
+   }
+}
+
+void profiler::clear() {
+   std::lock_guard g(my->mtx);
+   if (my->ring)
+      my->drain();
+   my->profile.clear();
+   my->samples = 0;
+   my->dropped = 0;
+}
+
+profiler::stats profiler::get_stats() const {
+   std::lock_guard g(my->mtx);
+   return {my->samples + (my->head.load() - my->tail.load()), my->dropped.load()};
+}
+
+} // namespace appbase
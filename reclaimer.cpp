@@ -0,0 +1,134 @@
+#include <appbase/reclaimer.hpp>
+#include <appbase/fast_clock.hpp>
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace appbase {
+
+struct reclaimer::impl {
+   struct node {
+      void*      p;
+      destroy_fn destroy;
+   };
+
+   mutable std::mutex      mtx;
+   std::condition_variable cv;
+   std::vector<node>       queue; ///< reserved to `capacity` so that retire() does not allocate
+   size_t                  capacity    = 0;
+   size_t                  in_progress = 0; ///< taken from `queue` by the reclaiming thread, not yet destroyed
+   std::thread             thread;
+   bool                    running  = false;
+   bool                    stopping = false;
+   stats                   st;
+
+   void run() {
+      std::vector<node> work;
+      work.reserve(capacity);
+      std::unique_lock g(mtx);
+      while (true) {
+         cv.wait(g, [&]() { return stopping || !queue.empty(); });
+         if (queue.empty())
+            break;
+         queue.swap(work);
+         in_progress = work.size();
+         g.unlock();
+
+         uint64_t total = 0, longest = 0;
+         for (const auto& n : work) {
+            const auto start = fast_clock::now();
+            n.destroy(n.p);
+            const uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(fast_clock::now() - start).count();
+            total += ns;
+            longest = std::max(longest, ns);
+         }
+
+         g.lock();
+         st.reclaimed += work.size();
+         st.reclaim_ns += total;
+         st.max_reclaim_ns = std::max(st.max_reclaim_ns, longest);
+         in_progress       = 0;
+         work.clear();
+         cv.notify_all(); // flush()
+      }
+   }
+};
+
+reclaimer& reclaimer::instance() {
+   static reclaimer r;
+   return r;
+}
+
+reclaimer::reclaimer() : my(new impl()) {}
+
+reclaimer::~reclaimer() {
+   stop();
+}
+
+void reclaimer::start(size_t max_backlog) {
+   stop();
+   std::lock_guard g(my->mtx);
+   my->capacity = max_backlog;
+   my->queue.clear();
+   my->queue.shrink_to_fit();
+   my->queue.reserve(max_backlog);
+   my->st       = {};
+   my->stopping = false;
+   my->running  = true;
+   my->thread   = std::thread([this]() { my->run(); });
+}
+
+void reclaimer::stop() {
+   {
+      std::lock_guard g(my->mtx);
+      if (!my->thread.joinable())
+         return;
+      my->running  = false;
+      my->stopping = true;
+   }
+   my->cv.notify_all();
+   my->thread.join();
+}
+
+bool reclaimer::running() const {
+   std::lock_guard g(my->mtx);
+   return my->running;
+}
+
+void reclaimer::retire(void* p, destroy_fn destroy) noexcept {
+   bool wake = false;
+   {
+      std::lock_guard g(my->mtx);
+      if (my->running && my->queue.size() < my->capacity) {
+         wake = my->queue.empty();
+         my->queue.push_back({p, destroy});
+         ++my->st.deferred;
+         my->st.peak_backlog = std::max(my->st.peak_backlog, my->queue.size() + my->in_progress);
+         p = nullptr;
+      } else {
+         ++my->st.inline_destroy;
+      }
+   }
+   if (wake)
+      my->cv.notify_all();
+   if (p)
+      destroy(p);
+}
+
+void reclaimer::flush() {
+   std::unique_lock g(my->mtx);
+   const uint64_t   target = my->st.deferred;
+   my->cv.wait(g, [&]() { return my->st.reclaimed >= target || !my->thread.joinable(); });
+}
+
+reclaimer::stats reclaimer::get_stats() const {
+   std::lock_guard g(my->mtx);
+   stats           s = my->st;
+   s.backlog         = my->queue.size() + my->in_progress;
+   return s;
+}
+
+} // namespace appbase
@@ -1,8 +1,18 @@
 #include <appbase/application.hpp>
+#include <appbase/static_wiring.hpp>
+#include <appbase/memory_residency.hpp>
 #include <iostream>
 #include <string_view>
 #include <thread>
 #include <future>
+#include <condition_variable>
+#include <ctime>
+#include <deque>
+#include <mutex>
+#include <filesystem>
+#include <fstream>
+#include <pthread.h>
+#include <unistd.h>
 #include <boost/exception/diagnostic_information.hpp>
 
 
@@ -461,3 +471,624 @@ BOOST_AUTO_TEST_CASE(queue_emptied_at_quit)
    BOOST_CHECK(num_computed < 100);
    BOOST_CHECK(shutdown_counter == 2); // make sure both plugins shutdown correctly,
 }
+
+// -----------------------------------------------------------------------------
+// Check that a `lazy-plugin` is initialized and started, with its dependencies,
+// only on first use of a method or channel it declares
+// -----------------------------------------------------------------------------
+using lazy_compute_method = appbase::method_decl<struct lazy_compute_tag, int(int)>;
+using lazy_events_channel = appbase::channel_decl<struct lazy_events_tag, int>;
+
+class lazy_dependency_plugin : public appbase::plugin<lazy_dependency_plugin>
+{
+public:
+   APPBASE_PLUGIN_REQUIRES();
+   virtual void set_program_options( options_description& cli, options_description& cfg ) override {}
+   void plugin_initialize( const variables_map& options ) {}
+   void plugin_startup() {}
+   void plugin_shutdown() {}
+};
+
+class lazy_plugin : public appbase::plugin<lazy_plugin>
+{
+public:
+   APPBASE_PLUGIN_REQUIRES( (lazy_dependency_plugin) );
+   APPBASE_PLUGIN_ACTIVATES_ON( (lazy_compute_method)(lazy_events_channel) );
+
+   virtual void set_program_options( options_description& cli, options_description& cfg ) override {}
+   void plugin_initialize( const variables_map& options ) {
+      provider = appbase::app().get_method<lazy_compute_method>().register_provider([](int x) { return x * 2; });
+   }
+   void plugin_startup() {}
+   void plugin_shutdown() {}
+
+   lazy_compute_method::method_type::handle provider;
+};
+
+BOOST_AUTO_TEST_CASE(lazy_plugin_activation)
+{
+   appbase::application::register_plugin<lazy_plugin>();
+
+   enum { use_method, use_channel, from_thread };
+   for (int use : {use_method, use_channel, from_thread}) {
+      appbase::scoped_app app;
+
+      const char* argv[] = { bu::framework::current_test_case().p_name->c_str(), "--lazy-plugin", "lazy_plugin" };
+      BOOST_REQUIRE(app->initialize(sizeof(argv) / sizeof(char*), const_cast<char**>(argv)));
+      app->startup();
+
+      auto& lazy = app->get_plugin<lazy_plugin>();
+      auto& dep  = app->get_plugin<lazy_dependency_plugin>();
+      BOOST_CHECK(lazy.get_state() == appbase::abstract_plugin::registered);
+      BOOST_CHECK(dep.get_state() == appbase::abstract_plugin::registered);
+
+      if (use == use_method) {
+         BOOST_CHECK_EQUAL(app->get_method<lazy_compute_method>()(21), 42);
+      } else if (use == use_channel) {
+         app->get_channel<lazy_events_channel>().publish(appbase::priority::medium, 1);
+      }
+
+      bool started = false;
+      auto check_started = [&]() {
+         started = lazy.get_state() == appbase::abstract_plugin::started &&
+                   dep.get_state() == appbase::abstract_plugin::started;
+         app->quit();
+      };
+      std::thread user;
+      if (use == from_thread) {
+         // activated on the main loop, the first call waits for it
+         user = std::thread([&]() {
+            BOOST_CHECK_EQUAL(app->get_method<lazy_compute_method>()(21), 42);
+            app->executor().post(appbase::priority::lowest, [&]() { check_started(); });
+         });
+      } else {
+         app->executor().post(appbase::priority::lowest, [&]() { check_started(); });
+      }
+      app->exec();
+      if (user.joinable())
+         user.join();
+      BOOST_CHECK(started);
+   }
+}
+
+// -----------------------------------------------------------------------------
+// Check that replace_plugin() drains the plugin's queued work, hands its state
+// to the new instance, and rebinds the method provider
+// -----------------------------------------------------------------------------
+using swap_counter_method = appbase::method_decl<struct swap_counter_tag, int()>;
+
+class swappable_plugin : public appbase::plugin<swappable_plugin>
+{
+public:
+   APPBASE_PLUGIN_REQUIRES();
+
+   explicit swappable_plugin(int generation = 1, bool fail_startup = false)
+      : generation(generation), fail_startup(fail_startup) {}
+   ~swappable_plugin() { destroyed.push_back(generation); }
+
+   virtual void set_program_options( options_description& cli, options_description& cfg ) override {}
+   void plugin_initialize( const variables_map& options ) {
+      provider = appbase::app().get_method<swap_counter_method>().register_provider(
+         [this]() { return generation * 100 + count; });
+   }
+   void plugin_startup() {
+      if (fail_startup)
+         throw std::runtime_error("startup failed");
+   }
+   void plugin_shutdown() { provider.unregister(); }
+
+   std::any plugin_export_state() { return count; }
+   void plugin_import_state(std::any state) { count = std::any_cast<int>(state); }
+
+   int generation;
+   bool fail_startup;
+   inline static std::vector<int> destroyed; ///< generations, in order of destruction
+   int count = 0;
+   swap_counter_method::method_type::handle provider;
+};
+
+BOOST_AUTO_TEST_CASE(plugin_hot_swap)
+{
+   appbase::application::register_plugin<swappable_plugin>();
+   appbase::scoped_app app;
+
+   const char* argv[] = { bu::framework::current_test_case().p_name->c_str() };
+   BOOST_REQUIRE(app->initialize<swappable_plugin>(sizeof(argv) / sizeof(char*), const_cast<char**>(argv)));
+   app->startup();
+
+   auto& q   = app->executor().get_priority_queue();
+   auto  tag = q.register_tag(app->get_plugin<swappable_plugin>().name());
+   for (int i = 0; i < 3; ++i)
+      app->executor().post(appbase::priority::low, tag, [&]() { ++app->get_plugin<swappable_plugin>().count; });
+
+   int before = 0, after = 0;
+   app->executor().post(appbase::priority::high, [&]() {
+      before = app->get_method<swap_counter_method>()();
+      app->replace_plugin(std::make_unique<swappable_plugin>(2), [&](std::exception_ptr e) {
+         BOOST_CHECK(!e);
+         BOOST_CHECK_EQUAL(q.pending(tag), 0u);
+         after = app->get_method<swap_counter_method>()();
+         app->quit();
+      });
+   });
+   app->exec();
+
+   BOOST_CHECK_EQUAL(before, 100);
+   BOOST_CHECK_EQUAL(after, 203);
+}
+
+// -----------------------------------------------------------------------------
+// Check that a failed replace_plugin() is reported to its callback and starts
+// the old instance again with its state, and that handlers the plugin keeps
+// adding are held back instead of delaying the replacement
+// -----------------------------------------------------------------------------
+BOOST_AUTO_TEST_CASE(plugin_hot_swap_failure)
+{
+   appbase::application::register_plugin<swappable_plugin>();
+   const char* argv[] = { bu::framework::current_test_case().p_name->c_str() };
+   {
+      appbase::scoped_app app;
+      BOOST_REQUIRE(app->initialize<swappable_plugin>(sizeof(argv) / sizeof(char*), const_cast<char**>(argv)));
+      app->startup();
+
+      auto tag = app->executor().get_priority_queue().register_tag(app->get_plugin<swappable_plugin>().name());
+      for (int i = 0; i < 2; ++i)
+         app->executor().post(appbase::priority::low, tag, [&]() { ++app->get_plugin<swappable_plugin>().count; });
+
+      std::exception_ptr error;
+      int after = 0;
+      app->executor().post(appbase::priority::high, [&]() {
+         app->replace_plugin(std::make_unique<swappable_plugin>(2, true), [&](std::exception_ptr e) {
+            error = e;
+            after = app->get_method<swap_counter_method>()();
+            app->quit();
+         });
+      });
+      swappable_plugin::destroyed.clear();
+      app->exec();
+      BOOST_CHECK_THROW(std::rethrow_exception(error), std::runtime_error);
+      BOOST_CHECK_EQUAL(after, 102);
+      // the replacement is discarded, the old instance stays registered until the plugins are destroyed
+      BOOST_CHECK((swappable_plugin::destroyed == std::vector<int>{2, 1}));
+   }
+   {
+      appbase::scoped_app app;
+      BOOST_REQUIRE(app->initialize<swappable_plugin>(sizeof(argv) / sizeof(char*), const_cast<char**>(argv)));
+      app->startup();
+
+      // keeps one handler of the plugin queued at all times
+      auto tag = app->executor().get_priority_queue().register_tag(app->get_plugin<swappable_plugin>().name());
+      bool replaced = false;
+      int runs = 0, runs_when_replaced = 0;
+      std::function<void()> requeue;
+      requeue = [&]() {
+         ++runs;
+         if (replaced && runs > runs_when_replaced + 2)
+            app->quit();
+         else
+            app->executor().post(appbase::priority::lowest, tag, [&]() { requeue(); });
+      };
+      app->executor().post(appbase::priority::lowest, tag, [&]() { requeue(); });
+      app->executor().post(appbase::priority::high, [&]() {
+         app->replace_plugin(std::make_unique<swappable_plugin>(2), [&](std::exception_ptr e) {
+            BOOST_CHECK(!e);
+            replaced = true;
+            runs_when_replaced = runs;
+         });
+      });
+      swappable_plugin::destroyed.clear();
+      app->exec();
+      BOOST_CHECK(replaced);
+      BOOST_CHECK_EQUAL(runs, runs_when_replaced + 3);
+      BOOST_CHECK((swappable_plugin::destroyed == std::vector<int>{1, 2}));
+   }
+}
+
+// -----------------------------------------------------------------------------
+// Check static_channel and static_method dispatch semantics
+// -----------------------------------------------------------------------------
+using static_events_channel = appbase::channel_decl<struct static_events_tag, int>;
+using static_compute_method = appbase::method_decl<struct static_compute_tag, int(int)>;
+using static_first_method   = appbase::method_decl<struct static_first_tag, int(int), appbase::first_provider_policy>;
+
+static int static_events_sum = 0;
+static void static_subscriber_add(const int& v) { static_events_sum += v; }
+static void static_subscriber_throw(const int&) { throw std::runtime_error("dropped"); }
+static int  static_provider_throw(int) { throw std::runtime_error("unavailable"); }
+static int  static_provider_double(int x) { return x * 2; }
+
+BOOST_AUTO_TEST_CASE(static_wiring)
+{
+   using events = appbase::static_channel<static_events_channel, &static_subscriber_add, &static_subscriber_throw,
+                                          &static_subscriber_add>;
+   events::dispatch(2);
+   BOOST_CHECK_EQUAL(static_events_sum, 4);
+
+   using compute = appbase::static_method<static_compute_method, &static_provider_throw, &static_provider_double>;
+   BOOST_CHECK_EQUAL(compute::call(21), 42);
+   using failing = appbase::static_method<static_compute_method, &static_provider_throw>;
+   BOOST_CHECK_THROW(failing::call(1), std::length_error);
+   using first = appbase::static_method<static_first_method, &static_provider_throw, &static_provider_double>;
+   BOOST_CHECK_THROW(first::call(1), std::runtime_error);
+
+   appbase::scoped_app app;
+   const char* argv[] = { bu::framework::current_test_case().p_name->c_str() };
+   BOOST_REQUIRE(app->initialize(sizeof(argv) / sizeof(char*), const_cast<char**>(argv)));
+   app->startup();
+   events::publish(app->executor(), appbase::priority::high, 5);
+   BOOST_CHECK_EQUAL(static_events_sum, 4);
+   app->executor().post(appbase::priority::lowest, [&]() { app->quit(); });
+   app->exec();
+   BOOST_CHECK_EQUAL(static_events_sum, 14);
+}
+
+// -----------------------------------------------------------------------------
+// Check that fast_clock is monotonic and tracks steady_clock
+// -----------------------------------------------------------------------------
+BOOST_AUTO_TEST_CASE(fast_clock_tracks_steady_clock)
+{
+   using namespace std::chrono;
+   appbase::fast_clock::calibrate();
+   std::cout << "fast_clock uses counter: " << appbase::fast_clock::uses_counter() << "\n";
+
+   auto prev = appbase::fast_clock::now();
+   for (int i = 0; i < 1000; ++i) {
+      auto t = appbase::fast_clock::now();
+      BOOST_CHECK(t >= prev);
+      prev = t;
+   }
+
+   auto f0 = appbase::fast_clock::now();
+   auto s0 = steady_clock::now();
+   std::this_thread::sleep_for(milliseconds(50));
+   auto f1 = appbase::fast_clock::now();
+   auto s1 = steady_clock::now();
+   auto drift = (f1 - f0) - (s1 - s0);
+   BOOST_CHECK_LT(std::abs(duration_cast<microseconds>(drift).count()), 500);
+   BOOST_CHECK_LT(std::abs(duration_cast<milliseconds>(f1.time_since_epoch() - s1.time_since_epoch()).count()), 5);
+
+   // wall time of a reading
+   const int64_t wall = appbase::fast_clock::now().time_since_epoch().count() + appbase::fast_clock::system_offset_ns();
+   const int64_t sys  = duration_cast<nanoseconds>(system_clock::now().time_since_epoch()).count();
+   BOOST_CHECK_LT(std::abs(sys - wall) / 1'000'000, 5);
+}
+
+// -----------------------------------------------------------------------------
+// Check that the memory residency options back and prefault appbase's pools
+// -----------------------------------------------------------------------------
+BOOST_AUTO_TEST_CASE(memory_residency_options)
+{
+   const auto before = appbase::memory_residency::get_stats();
+   size_t with_slabs = 0;
+   {
+      appbase::scoped_app app;
+      const char* argv[] = { bu::framework::current_test_case().p_name->c_str(), "--hugepages", "transparent",
+                             "--prefault-stack-kb", "256", "--prefault-handler-slabs", "1" };
+      BOOST_REQUIRE(app->initialize(sizeof(argv) / sizeof(char*), const_cast<char**>(argv)));
+      BOOST_CHECK(appbase::memory_residency::hugepages() == appbase::hugepage_mode::transparent);
+      BOOST_CHECK_EQUAL(appbase::memory_residency::stack_prefault(), 256u * 1024);
+      app->startup();
+
+      // one 2MiB slab for each of the handler pool's size classes
+      const auto after = appbase::memory_residency::get_stats();
+      BOOST_CHECK_GE(after.region_bytes - before.region_bytes, 8 * appbase::memory_residency::hugepage_size);
+      with_slabs = after.region_bytes;
+
+      app->executor().post(appbase::priority::lowest, [&]() { app->quit(); });
+      app->exec();
+   }
+   // the handler slabs are released with the executor, this thread's log buffer lives until the thread exits
+   BOOST_CHECK_LE(appbase::memory_residency::get_stats().region_bytes, with_slabs - 8 * appbase::memory_residency::hugepage_size);
+
+   // regions of a size which cannot be backed by explicit hugepages are not counted as falling back
+   appbase::memory_residency::set_hugepages(appbase::hugepage_mode::hugetlb);
+   const auto fallbacks = appbase::memory_residency::get_stats().fallbacks;
+   void* region = appbase::memory_residency::allocate_region(4096);
+   appbase::memory_residency::deallocate_region(region, 4096);
+   BOOST_CHECK_EQUAL(appbase::memory_residency::get_stats().fallbacks, fallbacks);
+
+   // prefaulting is bounded by the thread's own stack rather than the stack size limit
+   appbase::memory_residency::set_stack_prefault(size_t(64) << 20);
+   pthread_attr_t attr;
+   pthread_attr_init(&attr);
+   pthread_attr_setstacksize(&attr, size_t(1) << 20);
+   pthread_t thread;
+   size_t    prefaulted = SIZE_MAX;
+   BOOST_REQUIRE_EQUAL(pthread_create(&thread, &attr, [](void* out) -> void* {
+      *static_cast<size_t*>(out) = appbase::memory_residency::prefault_stack();
+      return nullptr;
+   }, &prefaulted), 0);
+   pthread_join(thread, nullptr);
+   pthread_attr_destroy(&attr);
+   BOOST_CHECK_GT(prefaulted, 0u);
+   BOOST_CHECK_LT(prefaulted, size_t(1) << 20);
+
+   appbase::memory_residency::set_hugepages(appbase::hugepage_mode::off);
+   appbase::memory_residency::set_stack_prefault(0);
+}
+
+// -----------------------------------------------------------------------------
+// Check that named caches share the cache budget, evict with CLOCK and admit
+// new entries by frequency
+// -----------------------------------------------------------------------------
+BOOST_AUTO_TEST_CASE(shared_caches)
+{
+   appbase::scoped_app app;
+   const char* argv[] = { bu::framework::current_test_case().p_name->c_str(), "--cache-budget-mb", "1" };
+   BOOST_REQUIRE(app->initialize(sizeof(argv) / sizeof(char*), const_cast<char**>(argv)));
+   auto& budget = app->get_cache_budget();
+   BOOST_CHECK_EQUAL(budget.limit(), 1u << 20);
+
+   constexpr size_t charge = 64 * 1024;
+   auto& a = app->get_cache<int, std::string>("a", 1);
+   BOOST_CHECK((&a == &app->get_cache<int, std::string>("a")));
+   BOOST_CHECK_THROW((app->get_cache<int, int>("a")), std::logic_error);
+
+   for (int i = 0; i < 16; ++i)
+      BOOST_CHECK(a.insert(i, std::to_string(i), charge));
+   BOOST_CHECK_EQUAL(budget.used(), 1u << 20);
+   for (int n = 0; n < 3; ++n)
+      for (int i = 0; i < 4; ++i)
+         BOOST_CHECK(a.get(i) == std::to_string(i));
+
+   // a key looked up once displaces an entry never read, a key never looked up does not
+   for (int i = 100; i < 108; ++i) {
+      BOOST_CHECK(!a.get(i));
+      BOOST_CHECK(a.insert(i, std::to_string(i), charge));
+   }
+   BOOST_CHECK(!a.insert(200, "200", charge));
+   BOOST_CHECK(!a.insert(201, "201", 2u << 20));   // larger than the budget
+   for (int i = 0; i < 4; ++i)
+      BOOST_CHECK(a.get(i).has_value());           // frequently read entries survive the scan
+
+   auto st = a.stats();
+   BOOST_CHECK_EQUAL(st.entries, 16u);
+   BOOST_CHECK_EQUAL(st.evictions, 8u);
+   BOOST_CHECK_EQUAL(st.rejections, 2u);
+   BOOST_CHECK_EQUAL(st.misses, 8u);
+   BOOST_CHECK_EQUAL(st.hits, 16u);
+
+   // an update replaces the value in place; one which is refused keeps the entry it would have replaced
+   BOOST_CHECK(a.insert(1, "one", charge));
+   BOOST_CHECK(!a.insert(0, "zero", 2u << 20));
+   BOOST_CHECK(a.get(0) == std::string("0"));
+   BOOST_CHECK(a.get(1) == std::string("one"));
+   BOOST_CHECK_EQUAL(a.stats().entries, 16u);
+   BOOST_CHECK_EQUAL(budget.used(), 1u << 20);
+
+   // a cache below its fair share takes the space from the caches above theirs
+   auto& b = app->get_cache<uint64_t, int>("b");
+   BOOST_CHECK(b.insert(1, 1, charge));
+   BOOST_CHECK_EQUAL(a.stats().evictions, 9u);
+   BOOST_CHECK_EQUAL(budget.used(), 1u << 20);
+   BOOST_CHECK(b.erase(1));
+   BOOST_CHECK_EQUAL(budget.used(), 15 * charge);
+
+   // concurrent use stays within the budget, up to the entries being inserted concurrently
+   std::vector<std::thread> threads;
+   for (int t = 0; t < 4; ++t) {
+      threads.emplace_back([&b, t]() {
+         for (uint64_t i = 0; i < 20000; ++i) {
+            const uint64_t key = (i * 7919 + t) % 4096;
+            if (!b.get(key))
+               b.insert(key, int(key), 1024);
+         }
+      });
+   }
+   for (auto& t : threads)
+      t.join();
+   st = b.stats();
+   BOOST_CHECK_EQUAL(st.bytes, st.entries * 1024);
+   BOOST_CHECK_EQUAL(budget.used(), a.bytes() + b.bytes());
+   BOOST_CHECK_LE(budget.used(), budget.limit() + 4 * 1024);
+   BOOST_CHECK_EQUAL(budget.stats().size(), 2u);
+}
+
+// -----------------------------------------------------------------------------
+// Check that crossing a memory threshold runs the shrinkers on the main loop,
+// caches first and then by decreasing order, until the target is released
+// -----------------------------------------------------------------------------
+BOOST_AUTO_TEST_CASE(memory_pressure_shrinkers)
+{
+   using mp = appbase::memory_pressure;
+   mp::config cfg;
+   cfg.rss_limit = 100 << 20;
+   BOOST_CHECK_EQUAL(mp::target_for(mp::sample{50 << 20}, cfg), 0u);
+   BOOST_CHECK_EQUAL(mp::target_for(mp::sample{200 << 20}, cfg), 110u << 20);   // down to 90% of the limit
+   BOOST_CHECK_EQUAL(mp::target_for(mp::sample{10 << 20, 95 << 20, 100 << 20}, cfg), 0u);   // cgroup ignored
+   cfg.cgroup_percent = 90;
+   BOOST_CHECK_EQUAL(mp::target_for(mp::sample{10 << 20, 95 << 20, 100 << 20}, cfg), 95u * (1 << 20) - 81u * (1 << 20));
+   cfg.psi_avg10 = 5;
+   BOOST_CHECK_EQUAL(mp::target_for(mp::sample{50 << 20, 0, 0, 7.5}, cfg), 5u << 20);
+
+   appbase::scoped_app app;
+   const char* argv[] = { bu::framework::current_test_case().p_name->c_str(), "--memory-pressure-interval-ms", "5",
+                          "--memory-pressure-rss-mb", "100" };
+   BOOST_REQUIRE(app->initialize(sizeof(argv) / sizeof(char*), const_cast<char**>(argv)));
+
+   auto& cache = app->get_cache<int, int>("pressure_test", 1);
+   for (int i = 0; i < 4; ++i)
+      cache.insert(i, i, 1 << 20);
+
+   std::atomic<uint64_t> rss = 50 << 20;
+   auto& monitor = app->get_memory_pressure();
+   monitor.set_sampler([&]() { return mp::sample{rss.load()}; });
+
+   std::vector<std::string> calls;
+   std::thread::id shrink_thread;
+   auto low = monitor.add_shrinker(1, "low", [&](size_t target) {
+      calls.push_back("low " + std::to_string(target >> 20));
+      shrink_thread = std::this_thread::get_id();
+      rss = 50 << 20;
+      app->quit();
+      return target;
+   });
+   auto high = monitor.add_shrinker(5, "high", [&](size_t target) {
+      calls.push_back("high " + std::to_string(target >> 20));
+      return size_t(100) << 20;
+   });
+   auto never = monitor.add_shrinker(0, "never", [&](size_t target) {
+      calls.push_back("never");
+      return target;
+   });
+
+   app->startup();
+   app->executor().post(appbase::priority::lowest, [&]() { rss = 200 << 20; });
+   app->exec();
+
+   const std::vector<std::string> expected = {"high 106", "low 6"};
+   BOOST_CHECK_EQUAL_COLLECTIONS(calls.begin(), calls.end(), expected.begin(), expected.end());
+   BOOST_CHECK(shrink_thread == std::this_thread::get_id());
+   BOOST_CHECK_EQUAL(cache.stats().entries, 0u);   // 4 MiB released by the caches first
+   BOOST_CHECK_EQUAL(monitor.get_stats().events, 1u);
+   BOOST_CHECK_EQUAL(monitor.get_stats().released, 110u << 20);
+}
+
+// -----------------------------------------------------------------------------
+// Check that the monitor backs off while shrinking does not lower memory use
+// -----------------------------------------------------------------------------
+BOOST_AUTO_TEST_CASE(memory_pressure_backoff)
+{
+   // shrinks posted by the monitor's thread run on this one
+   std::mutex                         mtx;
+   std::condition_variable            cv;
+   std::deque<std::function<void()>>  posted;
+   appbase::memory_pressure monitor([&](int, std::function<void()> f) {
+      std::lock_guard g(mtx);
+      posted.push_back(std::move(f));
+      cv.notify_all();
+   });
+   monitor.set_sampler([]() { return appbase::memory_pressure::sample{200 << 20}; }); // never goes down
+
+   int  shrinks = 0;
+   auto useless = monitor.add_shrinker(0, "useless", [&](size_t target) {
+      ++shrinks;
+      return target;
+   });
+
+   appbase::memory_pressure::config cfg;
+   cfg.interval  = std::chrono::milliseconds(1);
+   cfg.rss_limit = 100 << 20;
+   monitor.start(cfg);
+   while (shrinks < 4) {
+      std::function<void()> f;
+      {
+         std::unique_lock g(mtx);
+         cv.wait(g, [&]() { return !posted.empty(); });
+         f = std::move(posted.front());
+         posted.pop_front();
+      }
+      f();
+   }
+   monitor.stop();
+
+   // waits of 1, 2 and 4 samples between the shrinks, and of 8 after the last
+   BOOST_CHECK_EQUAL(monitor.get_stats().events, 4u);
+   BOOST_CHECK_GE(monitor.get_stats().skipped, 7u);
+   BOOST_CHECK_LE(monitor.get_stats().skipped, 15u);
+}
+
+// -----------------------------------------------------------------------------
+// Check that without heap accounting, subscribers and providers run under the
+// tag of the publisher or caller (see heap_accounting_test.cpp when enabled)
+// -----------------------------------------------------------------------------
+using tagged_events_channel = appbase::channel_decl<struct tagged_events_tag, int>;
+using tagged_query_method   = appbase::method_decl<struct tagged_query_tag, uint32_t()>;
+
+BOOST_AUTO_TEST_CASE(subscriber_tag_without_heap_accounting)
+{
+   appbase::scoped_app app;
+   const char* argv[] = { bu::framework::current_test_case().p_name->c_str() };
+   BOOST_REQUIRE(app->initialize(sizeof(argv) / sizeof(char*), const_cast<char**>(argv)));
+   BOOST_REQUIRE(!appbase::heap_accounting::enabled());
+   app->startup();
+
+   auto& q          = app->executor().get_priority_queue();
+   auto  subscriber = q.register_tag("subscriber");
+   auto  publisher  = q.register_tag("publisher");
+
+   uint32_t seen = appbase::execution_priority_queue::default_tag;
+   tagged_events_channel::channel_type::handle events;
+   tagged_query_method::method_type::handle    query;
+   {
+      appbase::execution_priority_queue::scoped_tag tag(subscriber);
+      events = app->get_channel<tagged_events_channel>().subscribe(
+         [&](const int&) { seen = appbase::execution_priority_queue::current_tag(); });
+      query = app->get_method<tagged_query_method>().register_provider(
+         []() { return appbase::execution_priority_queue::current_tag(); });
+   }
+
+   uint32_t provided = appbase::execution_priority_queue::default_tag;
+   app->executor().post(appbase::priority::high, publisher, [&]() {
+      app->get_channel<tagged_events_channel>().publish(appbase::priority::high, 1);
+      provided = app->get_method<tagged_query_method>()();
+   });
+   app->executor().post(appbase::priority::lowest, [&]() { app->quit(); });
+   app->exec();
+
+   BOOST_CHECK_EQUAL(seen, publisher);
+   BOOST_CHECK_EQUAL(provided, publisher);
+}
+
+// -----------------------------------------------------------------------------
+// Check that profile samples of the main loop are split by plugin and handler
+// -----------------------------------------------------------------------------
+class profiled_plugin : public appbase::plugin<profiled_plugin>
+{
+public:
+   APPBASE_PLUGIN_REQUIRES();
+
+   virtual void set_program_options( options_description& cli, options_description& cfg ) override {}
+   void plugin_initialize( const variables_map& options ) {}
+   void plugin_startup() {
+      appbase::app().executor().post(appbase::priority::medium, [this]() {
+         // burn 300ms of the main thread's CPU time in a handler attributed to this plugin
+         const auto cpu_ms = []() {
+            timespec ts;
+            ::clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+            return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+         };
+         const auto until = cpu_ms() + 300;
+         while (cpu_ms() < until)
+            sum = sum + 1;
+         appbase::app().quit();
+      });
+   }
+   void plugin_shutdown() {}
+
+   volatile uint64_t sum = 0;
+};
+
+BOOST_AUTO_TEST_CASE(profiler_folded_stacks)
+{
+   appbase::application::register_plugin<profiled_plugin>();
+   appbase::scoped_app app;
+
+   const auto dir  = std::filesystem::temp_directory_path() / ("appbase_profile_" + std::to_string(::getpid()));
+   const auto file = dir / "main.folded";
+   std::filesystem::create_directories(dir);
+   const std::string data_dir = dir.string();
+   const char* argv[] = { bu::framework::current_test_case().p_name->c_str(), "--data-dir", data_dir.c_str(),
+                          "--profile-hz", "1000", "--profile-file", "main.folded" };
+   BOOST_REQUIRE(app->initialize<profiled_plugin>(sizeof(argv) / sizeof(char*), const_cast<char**>(argv)));
+   appbase::profiler::instance().clear();
+   app->startup();
+   BOOST_REQUIRE(appbase::profiler::instance().running());
+   app->exec();
+   BOOST_CHECK(!appbase::profiler::instance().running());
+
+   std::ifstream in(file);
+   uint64_t plugin_samples = 0, total = 0;
+   for (std::string line; std::getline(in, line);) {
+      const auto count = std::stoull(line.substr(line.rfind(' ') + 1));
+      total += count;
+      if (line.compare(0, 16, "profiled_plugin;") == 0) {
+         plugin_samples += count;
+         BOOST_CHECK(line.find("profiled_plugin::plugin_startup") != std::string::npos); // the handler's label
+      }
+   }
+   BOOST_TEST_MESSAGE(total << " samples, " << plugin_samples << " in profiled_plugin");
+   BOOST_CHECK_GE(plugin_samples, 100u); // of ~300
+   BOOST_CHECK_GE(plugin_samples * 2, total);
+   std::filesystem::remove_all(dir);
+}
@@ -0,0 +1,1092 @@
+#include <appbase/application.hpp>
+#include <appbase/thread_pool.hpp>
+#include <appbase/execution.hpp>
+#include <appbase/async_sync.hpp>
+#include <appbase/counting_resource.hpp>
+#include <appbase/qsbr.hpp>
+#include <thread>
+#include <future>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+using namespace appbase;
+
+// -----------------------------------------------------------------------------
+// Run `f` on the application main loop and wait for the app to exit.
+// `f` is responsible for calling app().quit() when done.
+// -----------------------------------------------------------------------------
+template <typename F>
+static void run_app(F&& f) {
+   appbase::scoped_app app;
+
+   const char* argv[] = { boost::unit_test::framework::current_test_case().p_name->c_str() };
+   BOOST_REQUIRE(app->initialize(1, const_cast<char**>(argv)));
+   app->startup();
+   app->executor().post(priority::lowest, std::forward<F>(f));
+   app->exec();
+}
+
+// -----------------------------------------------------------------------------
+// Nested posts, wraps and channel publishes inherit the priority of the handler
+// that started them.
+// -----------------------------------------------------------------------------
+BOOST_AUTO_TEST_CASE(priority_inherited_by_nested_posts)
+{
+   execution_priority_queue q;
+   int outside = priority::inherit(0, priority::low);
+   int nested = 0, boosted = 0, decayed = 0, saturated = 0;
+   q.add(priority::high, 0, [&]() {
+      nested    = priority::inherit();
+      boosted   = priority::inherit(+5);
+      decayed   = priority::inherit(-5);
+      saturated = priority::inherit(std::numeric_limits<int>::max());
+   });
+   q.execute_all();
+
+   BOOST_CHECK_EQUAL(outside, priority::low);
+   BOOST_CHECK_EQUAL(nested, priority::high);
+   BOOST_CHECK_EQUAL(boosted, priority::high + 5);
+   BOOST_CHECK_EQUAL(decayed, priority::high - 5);
+   BOOST_CHECK_EQUAL(saturated, priority::highest);
+   BOOST_CHECK(!execution_priority_queue::executing());
+}
+
+BOOST_AUTO_TEST_CASE(priority_inherited_through_executor)
+{
+   using test_channel = channel_decl<struct test_channel_tag, int>;
+
+   std::vector<int> seen;
+   run_app([&]() {
+      auto sub = std::make_shared<test_channel::channel_type::handle>(
+         app().get_channel<test_channel>().subscribe([&](int) { seen.push_back(priority::inherit()); }));
+      app().executor().post(priority::high, [&, sub]() {
+         app().executor().post([&]() { seen.push_back(priority::inherit()); });
+         app().get_channel<test_channel>().publish(1);
+         app().executor().post(priority::low, [&, sub]() {
+            seen.push_back(priority::inherit());
+            app().quit();
+         });
+      });
+   });
+
+   BOOST_REQUIRE_EQUAL(seen.size(), 3u);
+   BOOST_CHECK_EQUAL(seen[0], priority::high);
+   BOOST_CHECK_EQUAL(seen[1], priority::high);
+   BOOST_CHECK_EQUAL(seen[2], priority::low);
+}
+
+// -----------------------------------------------------------------------------
+// A tag flooding a fair queued level does not starve another tag at the same
+// level, weights are respected, and handlers of a tag stay FIFO.
+// -----------------------------------------------------------------------------
+BOOST_AUTO_TEST_CASE(fair_queuing_within_priority)
+{
+   execution_priority_queue q;
+   q.enable_fair_queuing(priority::medium);
+   auto chatty = q.register_tag("chatty_plugin");
+   auto api    = q.register_tag("api_plugin");
+   BOOST_CHECK_EQUAL(q.register_tag("api_plugin"), api);
+   BOOST_CHECK_EQUAL(q.tag_name(api), "api_plugin");
+   q.set_tag_weight(api, 2);
+
+   size_t order = std::numeric_limits<size_t>::max();
+   std::vector<std::pair<execution_priority_queue::queue_tag, int>> ran;
+   for (int i = 0; i < 100; ++i)
+      q.add(priority::medium, --order, chatty, [&ran, chatty, i]() { ran.emplace_back(chatty, i); });
+   for (int i = 0; i < 10; ++i)
+      q.add(priority::medium, --order, api, [&ran, api, i]() { ran.emplace_back(api, i); });
+   q.add(priority::high, --order, chatty, [&ran]() { ran.emplace_back(0, -1); });
+   q.execute_all();
+
+   BOOST_REQUIRE_EQUAL(ran.size(), 111u);
+   BOOST_CHECK_EQUAL(ran[0].second, -1); // higher priority level is unaffected
+   // with weight 2 vs 1, all 10 api handlers run within the first ~15 of the level
+   size_t api_done = 0;
+   for (size_t i = 1; i < 17; ++i)
+      api_done += ran[i].first == api;
+   BOOST_CHECK_EQUAL(api_done, 10u);
+   int last_chatty = -1, last_api = -1;
+   for (size_t i = 1; i < ran.size(); ++i) {
+      int& last = ran[i].first == api ? last_api : last_chatty;
+      BOOST_CHECK_LT(last, ran[i].second);
+      last = ran[i].second;
+   }
+}
+
+BOOST_AUTO_TEST_CASE(tag_inherited_by_nested_handlers)
+{
+   execution_priority_queue q;
+   auto tag = q.register_tag("some_plugin");
+   execution_priority_queue::queue_tag nested = execution_priority_queue::default_tag;
+   {
+      execution_priority_queue::scoped_tag scoped(tag);
+      q.add(priority::low, 1, [&]() {
+         q.add(priority::low, 0, [&]() { nested = execution_priority_queue::current_tag(); });
+      });
+   }
+   BOOST_CHECK_EQUAL(execution_priority_queue::current_tag(), execution_priority_queue::default_tag);
+   q.execute_all();
+   BOOST_CHECK_EQUAL(nested, tag);
+}
+
+// -----------------------------------------------------------------------------
+// Handlers added under a held tag wait for release() while those queued before
+// drain, and can still be cancelled.
+// -----------------------------------------------------------------------------
+BOOST_AUTO_TEST_CASE(held_tag_drains)
+{
+   execution_priority_queue q;
+   auto tag = q.register_tag("some_plugin");
+   std::vector<int> ran;
+   std::function<void()> requeue = [&]() {
+      ran.push_back(0);
+      q.add(priority::low, 0, tag, [&]() { requeue(); });
+   };
+   q.add(priority::low, 3, tag, [&]() { requeue(); });
+   q.hold(tag);
+   q.add(priority::high, 2, tag, [&]() { ran.push_back(1); });
+   auto cancelled = std::make_shared<execution_priority_queue::task>(priority::highest);
+   q.add_tracked(1, tag, [&]() { ran.push_back(2); }, cancelled);
+   q.add(priority::low, 0, [&]() { ran.push_back(3); });
+   BOOST_CHECK_EQUAL(q.pending(tag), 1u);
+   BOOST_CHECK(q.cancel(*cancelled));
+   q.execute_all();
+   BOOST_CHECK((ran == std::vector<int>{0, 3}));
+   BOOST_CHECK_EQUAL(q.pending(tag), 0u);
+
+   q.release(tag);
+   BOOST_CHECK_EQUAL(q.pending(tag), 2u);
+   q.execute_highest();
+   q.execute_highest();
+   BOOST_CHECK((ran == std::vector<int>{0, 3, 1, 0}));
+   q.clear();
+}
+
+// -----------------------------------------------------------------------------
+// quiesce() completes after everything queued at or above the priority before
+// the call, without waiting for lower priority work.
+// -----------------------------------------------------------------------------
+BOOST_AUTO_TEST_CASE(quiesce_barrier)
+{
+   std::vector<std::string> ran;
+   run_app([&]() {
+      auto& exec = app().executor();
+      exec.get_priority_queue().enable_fair_queuing(priority::medium);
+      auto other = exec.get_priority_queue().register_tag("other");
+      exec.post(priority::low, [&]() { ran.push_back("low"); });
+      for (int i = 0; i < 3; ++i)
+         exec.post(priority::medium, other, [&]() { ran.push_back("medium"); });
+      exec.post(priority::high, [&]() { ran.push_back("high"); });
+      exec.quiesce(priority::medium, [&]() { ran.push_back("quiesced"); });
+      exec.post(priority::low, [&]() { app().quit(); });
+   });
+
+   BOOST_REQUIRE_EQUAL(ran.size(), 6u);
+   BOOST_CHECK_EQUAL(ran[0], "high");
+   BOOST_CHECK_EQUAL(ran[3], "medium");
+   BOOST_CHECK_EQUAL(ran[4], "quiesced");
+   BOOST_CHECK_EQUAL(ran[5], "low");
+}
+
+BOOST_AUTO_TEST_CASE(quiesce_future_from_other_thread)
+{
+   appbase::scoped_app app;
+   const char* argv[] = { boost::unit_test::framework::current_test_case().p_name->c_str() };
+   BOOST_REQUIRE(app->initialize(1, const_cast<char**>(argv)));
+
+   std::atomic<int> done = 0;
+   std::thread app_thread([&]() {
+      app->startup();
+      app->exec();
+   });
+
+   for (int i = 0; i < 10; ++i)
+      app->executor().post(priority::high, [&]() { ++done; });
+   app->executor().quiesce(priority::high, boost::asio::use_future).get();
+   BOOST_CHECK_EQUAL(done, 10);
+
+   app->quit();
+   app_thread.join();
+}
+
+// -----------------------------------------------------------------------------
+// safepoint::run() pauses all thread_pool threads between handlers.
+// -----------------------------------------------------------------------------
+BOOST_AUTO_TEST_CASE(safepoint_pauses_thread_pools)
+{
+   safepoint sp;
+   thread_pool pool1{sp}, pool2{sp};
+   pool1.start(3, [](std::exception_ptr) {});
+   pool2.start(2, [](std::exception_ptr) {});
+
+   std::atomic<uint64_t> counter = 0;
+   std::atomic<bool> stop = false;
+   std::function<void(thread_pool&)> spin = [&](thread_pool& p) {
+      ++counter;
+      if (!stop)
+         boost::asio::post(p.get_executor(), [&]() { spin(p); });
+   };
+   boost::asio::post(pool1.get_executor(), [&]() { spin(pool1); });
+   boost::asio::post(pool2.get_executor(), [&]() { spin(pool2); });
+
+   while (counter < 1000)
+      std::this_thread::yield();
+
+   for (int i = 0; i < 3; ++i) {
+      bool unchanged = sp.run([&]() {
+         auto before = counter.load();
+         std::this_thread::sleep_for(std::chrono::milliseconds(10));
+         return before == counter.load();
+      });
+      BOOST_CHECK(unchanged);
+   }
+   BOOST_CHECK_EQUAL(sp.participants(), 5u);
+
+   auto before = counter.load();
+   while (counter == before)
+      std::this_thread::yield(); // resumed
+
+   // idle pools are woken to reach the safepoint
+   stop = true;
+   std::this_thread::sleep_for(std::chrono::milliseconds(10));
+   BOOST_CHECK(sp.run([]() { return true; }));
+
+   pool1.stop();
+   pool2.stop();
+   BOOST_CHECK_EQUAL(sp.participants(), 0u);
+}
+
+// -----------------------------------------------------------------------------
+// safepoint::run() resumes participants when a waker throws
+// -----------------------------------------------------------------------------
+BOOST_AUTO_TEST_CASE(safepoint_waker_throws)
+{
+   safepoint sp;
+   auto waker = sp.add_waker([]() { throw std::runtime_error("waker"); });
+   BOOST_CHECK_THROW(sp.run([]() { return true; }), std::runtime_error);
+   sp.remove_waker(waker);
+
+   thread_pool pool{sp};
+   pool.start(2, [](std::exception_ptr) {});
+   BOOST_CHECK(sp.run([]() { return true; }));
+   pool.stop();
+}
+
+// -----------------------------------------------------------------------------
+// safepoint::run() called at the same time from two participants runs both
+// -----------------------------------------------------------------------------
+BOOST_AUTO_TEST_CASE(safepoint_run_from_participants)
+{
+   safepoint sp;
+   thread_pool pool{sp};
+   pool.start(4, [](std::exception_ptr) {});
+
+   std::atomic<int> arrived = 0, ran = 0, inside = 0;
+   std::atomic<bool> overlapped = false;
+   std::promise<void> done1, done2;
+   auto caller = [&](std::promise<void>& done) {
+      return [&]() {
+         ++arrived;
+         while (arrived < 2)
+            std::this_thread::yield();
+         sp.run([&]() {
+            if (++inside > 1)
+               overlapped = true;
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            --inside;
+            ++ran;
+         });
+         done.set_value();
+      };
+   };
+   boost::asio::post(pool.get_executor(), caller(done1));
+   boost::asio::post(pool.get_executor(), caller(done2));
+
+   BOOST_CHECK(done1.get_future().wait_for(std::chrono::seconds(30)) == std::future_status::ready);
+   BOOST_CHECK(done2.get_future().wait_for(std::chrono::seconds(30)) == std::future_status::ready);
+   BOOST_CHECK_EQUAL(ran.load(), 2);
+   BOOST_CHECK(!overlapped);
+   pool.stop();
+}
+
+// -----------------------------------------------------------------------------
+// post_bulk() queues all callables in order, FIFO with surrounding posts.
+// -----------------------------------------------------------------------------
+BOOST_AUTO_TEST_CASE(post_bulk_in_order)
+{
+   std::vector<int> ran;
+   run_app([&]() {
+      auto& exec = app().executor();
+      exec.post(priority::medium, [&]() { ran.push_back(-1); });
+      std::vector<std::function<void()>> funcs;
+      for (int i = 0; i < 1000; ++i)
+         funcs.emplace_back([&ran, i]() { ran.push_back(i); });
+      exec.post_bulk(priority::medium, std::move(funcs));
+      exec.post_bulk(priority::medium, std::vector<std::function<void()>>{});
+      exec.post(priority::medium, [&]() { ran.push_back(1000); });
+      exec.post(priority::low, [&]() { app().quit(); });
+   });
+
+   BOOST_REQUIRE_EQUAL(ran.size(), 1002u);
+   for (size_t i = 0; i < ran.size(); ++i)
+      BOOST_CHECK_EQUAL(ran[i], int(i) - 1);
+}
+
+// -----------------------------------------------------------------------------
+// add_unique()/post_unique() coalesce handlers with the same key while queued.
+// -----------------------------------------------------------------------------
+BOOST_AUTO_TEST_CASE(unique_handlers_coalesced)
+{
+   using dup = execution_priority_queue::on_duplicate;
+   execution_priority_queue q;
+   std::vector<std::string> ran;
+   size_t order = 100;
+   auto tag = execution_priority_queue::default_tag;
+
+   BOOST_CHECK(q.add_unique("x", priority::low, --order, tag, [&]() { ran.push_back("x1"); }, dup::drop, false));
+   BOOST_CHECK(!q.add_unique("x", priority::low, --order, tag, [&]() { ran.push_back("x2"); }, dup::drop, false));
+   BOOST_CHECK(q.add_unique("y", priority::low, --order, tag, [&]() { ran.push_back("y1"); }, dup::drop, false));
+   BOOST_CHECK(!q.add_unique("y", priority::low, --order, tag, [&]() { ran.push_back("y2"); }, dup::replace, false));
+   q.add(priority::medium, --order, [&]() { ran.push_back("medium"); });
+   BOOST_CHECK(!q.add_unique("y", priority::high, --order, tag, [&]() { ran.push_back("y3"); }, dup::drop, true));
+   BOOST_CHECK_EQUAL(q.size(), 3u);
+   q.execute_all();
+   BOOST_CHECK((ran == std::vector<std::string>{"y2", "medium", "x1"}));
+
+   // once executed the key is free again, also for handlers added while executing
+   ran.clear();
+   BOOST_CHECK(q.add_unique("x", priority::low, --order, tag, [&]() {
+      ran.push_back("x3");
+      BOOST_CHECK(q.add_unique("x", priority::low, --order, tag, [&]() { ran.push_back("x4"); }, dup::drop, false));
+   }, dup::drop, false));
+   q.execute_all();
+   BOOST_CHECK((ran == std::vector<std::string>{"x3", "x4"}));
+}
+
+BOOST_AUTO_TEST_CASE(post_unique_through_executor)
+{
+   int recomputed = 0;
+   run_app([&]() {
+      for (int i = 0; i < 100; ++i)
+         app().executor().post_unique("recompute", priority::medium, [&]() { ++recomputed; });
+      app().executor().post(priority::low, [&]() { app().quit(); });
+   });
+   BOOST_CHECK_EQUAL(recomputed, 1);
+}
+
+// -----------------------------------------------------------------------------
+// Tracked handlers can be reprioritized or cancelled while queued.
+// -----------------------------------------------------------------------------
+BOOST_AUTO_TEST_CASE(reprioritize_tracked_handlers)
+{
+   execution_priority_queue q;
+   std::vector<int> ran;
+   size_t order = 100;
+   auto tag = execution_priority_queue::default_tag;
+   std::vector<std::shared_ptr<execution_priority_queue::task>> tasks;
+   for (int i = 0; i < 5; ++i) {
+      tasks.push_back(std::make_shared<execution_priority_queue::task>(priority::medium));
+      q.add_tracked(--order, tag, [&ran, i]() { ran.push_back(i); }, tasks.back());
+   }
+   auto late = std::make_shared<execution_priority_queue::task>(priority::low);
+   BOOST_CHECK(!q.set_priority(*late, priority::highest)); // before being added
+   q.add_tracked(--order, tag, [&ran]() { ran.push_back(5); }, late);
+
+   BOOST_CHECK(q.set_priority(*tasks[3], priority::high));
+   BOOST_CHECK(q.set_priority(*tasks[0], priority::low));
+   BOOST_CHECK(q.cancel(*tasks[2]));
+   BOOST_CHECK(!tasks[2]->pending());
+   BOOST_CHECK(tasks[1]->pending());
+   q.execute_all();
+
+   BOOST_CHECK((ran == std::vector<int>{5, 3, 1, 4, 0}));
+   for (auto& t : tasks)
+      BOOST_CHECK(!t->pending());
+   BOOST_CHECK(!q.set_priority(*tasks[1], priority::high));
+   BOOST_CHECK(!q.cancel(*tasks[1]));
+}
+
+BOOST_AUTO_TEST_CASE(post_with_handle_through_executor)
+{
+   std::vector<std::string> ran;
+   run_app([&]() {
+      auto& exec = app().executor();
+      auto background = exec.post_with_handle(priority::low, [&]() { ran.push_back("background"); });
+      auto dropped = exec.post_with_handle(priority::low, [&]() { ran.push_back("dropped"); });
+      exec.post(priority::medium, [&]() { ran.push_back("medium"); });
+      exec.post(priority::high, [&, background, dropped]() mutable {
+         background.set_priority(priority::highest); // a client is now waiting on it
+         dropped.cancel();
+      });
+      exec.post(priority::lowest, [&]() { app().quit(); });
+   });
+   BOOST_CHECK((ran == std::vector<std::string>{"background", "medium"}));
+}
+
+// -----------------------------------------------------------------------------
+// use_priority() completes asio operations into the priority queue, and runs
+// inline when already running at an equal or higher priority.
+// -----------------------------------------------------------------------------
+BOOST_AUTO_TEST_CASE(use_priority_completion)
+{
+   std::vector<std::string> ran;
+   boost::asio::steady_timer* timer = nullptr;
+   run_app([&]() {
+      timer = new boost::asio::steady_timer(app().get_io_context(), std::chrono::milliseconds(1));
+      timer->async_wait(use_priority(priority::high, [&](const boost::system::error_code& ec) {
+         BOOST_CHECK(!ec);
+         ran.push_back("timer " + std::to_string(priority::inherit()));
+         auto h = use_priority(priority::medium, [&](int v) { ran.push_back("inline " + std::to_string(v)); });
+         h(1);
+         ran.push_back("after inline");
+         auto q = use_priority(priority::highest, [&](int v) { ran.push_back("queued " + std::to_string(v)); });
+         q(2);
+         ran.push_back("after queued");
+         app().executor().post(priority::lowest, [&]() { app().quit(); });
+      }));
+   });
+   delete timer;
+
+   BOOST_CHECK((ran == std::vector<std::string>{"timer " + std::to_string(priority::high), "inline 1", "after inline",
+                                                "after queued", "queued 2"}));
+}
+
+// -----------------------------------------------------------------------------
+// asio dispatch() through the priority queue executor runs inline from the main
+// loop when priority allows, with a bounded nesting depth.
+// -----------------------------------------------------------------------------
+BOOST_AUTO_TEST_CASE(dispatch_runs_inline)
+{
+   std::vector<std::string> ran;
+   uint32_t max_depth = 0;
+   int inline_priority = 0;
+   bool own_label = false;
+   run_app([&]() {
+      app().executor().post(priority::high, [&]() {
+         const char* outer = execution_priority_queue::current_handler_label();
+         boost::asio::dispatch(app().executor().wrap(priority::medium, [&]() {
+            ran.push_back("inline");
+            // nested work and the profiler see the inline function rather than the handler dispatching it
+            inline_priority = priority::inherit();
+            own_label = execution_priority_queue::current_handler_label() != outer;
+         }));
+         ran.push_back("after inline");
+         boost::asio::dispatch(app().executor().wrap(priority::highest, [&]() { ran.push_back("queued"); }));
+         ran.push_back("after queued");
+
+         app().executor().post(priority::high, [&]() {
+            auto recurse = std::make_shared<std::function<void(uint32_t)>>();
+            *recurse = [&, r = std::weak_ptr(recurse)](uint32_t depth) {
+               max_depth = std::max(max_depth, depth);
+               if (depth < 20)
+                  boost::asio::dispatch(app().executor().wrap(priority::high, [depth, r = r.lock()]() { (*r)(depth + 1); }));
+            };
+            (*recurse)(0);
+            BOOST_CHECK_EQUAL(max_depth, execution_priority_queue::max_inline_depth);
+            app().executor().post(priority::lowest, [&]() { app().quit(); });
+         });
+      });
+   });
+
+   BOOST_CHECK((ran == std::vector<std::string>{"inline", "after inline", "after queued", "queued"}));
+   BOOST_CHECK_EQUAL(inline_priority, priority::medium);
+   BOOST_CHECK(own_label);
+   BOOST_CHECK_EQUAL(max_depth, 20u);
+}
+
+// -----------------------------------------------------------------------------
+// Senders: schedule/then/when_all run on the main loop at their priority and
+// compose with sync_wait from another thread.
+// -----------------------------------------------------------------------------
+BOOST_AUTO_TEST_CASE(senders_compose_on_main_loop)
+{
+   using namespace appbase::execution;
+
+   std::thread::id main_id, high_id, low_id;
+   int high_pri = 0, low_pri = 0;
+   std::optional<std::tuple<int, std::string, std::monostate>> result;
+   bool threw = false;
+   std::thread t;
+
+   run_app([&]() {
+      main_id = std::this_thread::get_id();
+      t = std::thread([&]() {
+         auto sched = get_scheduler(app());
+         result = sync_wait(when_all(sched.schedule(priority::high) | then([&]() {
+                                        high_id = std::this_thread::get_id();
+                                        high_pri = priority::inherit();
+                                        return 42;
+                                     }),
+                                     then(sched.schedule(priority::low), [&]() {
+                                        low_id = std::this_thread::get_id();
+                                        low_pri = priority::inherit();
+                                        return std::string("low");
+                                     }),
+                                     sched.schedule()));
+         try {
+            sync_wait(sched.schedule() | then([]() -> int { throw std::runtime_error("boom"); }));
+         } catch (const std::runtime_error&) {
+            threw = true;
+         }
+         app().executor().post(priority::lowest, []() { app().quit(); });
+      });
+   });
+   t.join();
+
+   BOOST_REQUIRE(result);
+   BOOST_CHECK_EQUAL(std::get<0>(*result), 42);
+   BOOST_CHECK_EQUAL(std::get<1>(*result), "low");
+   BOOST_CHECK(high_id == main_id);
+   BOOST_CHECK(low_id == main_id);
+   BOOST_CHECK_EQUAL(high_pri, priority::high);
+   BOOST_CHECK_EQUAL(low_pri, priority::low);
+   BOOST_CHECK(threw);
+}
+
+BOOST_AUTO_TEST_CASE(senders_stopped_when_quitting)
+{
+   using namespace appbase::execution;
+
+   struct test_receiver {
+      int* values;
+      int* stopped;
+      void set_value() { ++*values; }
+      void set_error(std::exception_ptr) {}
+      void set_stopped() { ++*stopped; }
+   };
+   using sender_t = schedule_sender<appbase::default_executor>;
+   struct op_holder {
+      op_holder(sender_t s, test_receiver r) : op(std::move(s).connect(r)) {}
+      connect_result_t<sender_t, test_receiver> op;
+   };
+
+   int values = 0, stopped = 0;
+   std::optional<op_holder> before, after;
+   run_app([&]() {
+      auto sched = get_scheduler(app());
+      before.emplace(sched.schedule(priority::high), test_receiver{&values, &stopped});
+      before->op.start();
+      app().executor().post(priority::low, [&, sched]() {
+         app().quit();
+         after.emplace(sched.schedule(priority::high), test_receiver{&values, &stopped});
+         after->op.start();
+      });
+   });
+
+   BOOST_CHECK_EQUAL(values, 1);
+   BOOST_CHECK_EQUAL(stopped, 1);
+}
+
+// -----------------------------------------------------------------------------
+// Channel streams buffer messages in a bounded ring consumed with async_next()
+// at the stream's priority.
+// -----------------------------------------------------------------------------
+BOOST_AUTO_TEST_CASE(channel_stream_bounded)
+{
+   using test_channel = channel_decl<struct stream_channel_tag, int>;
+
+   std::vector<int> received, priorities;
+   std::vector<int> batch;
+   uint64_t dropped = 0;
+   bool ended = false;
+   run_app([&]() {
+      auto sub = std::make_shared<test_channel::channel_type::stream>(
+         app().get_channel<test_channel>().subscribe_stream(priority::high, 4, stream_overflow::drop_oldest));
+      for (int i = 0; i < 6; ++i)
+         app().get_channel<test_channel>().publish(priority::medium, i);
+
+      app().executor().post(priority::low, [&, sub]() {
+         dropped = sub->dropped();
+         sub->async_next([&, sub](std::optional<int> first) {
+            received.push_back(*first);
+            priorities.push_back(priority::inherit());
+            while (auto msg = sub->try_next())
+               batch.push_back(*msg);
+            sub->async_next([&, sub](std::optional<int> msg) {
+               received.push_back(*msg);
+               sub->close();
+               sub->async_next([&, sub](std::optional<int> msg) {
+                  ended = !msg;
+                  app().quit();
+               });
+            });
+            app().get_channel<test_channel>().publish(priority::medium, 10);
+         });
+      });
+   });
+
+   BOOST_CHECK_EQUAL(dropped, 2u);
+   BOOST_CHECK(received == std::vector<int>({2, 10}));
+   BOOST_CHECK(batch == std::vector<int>({3, 4, 5}));
+   BOOST_CHECK(priorities == std::vector<int>({priority::high}));
+   BOOST_CHECK(ended);
+}
+
+// -----------------------------------------------------------------------------
+// Messages which no subscriber can take, every one being a full drop_newest
+// stream, are dropped by publish() rather than posted.
+// -----------------------------------------------------------------------------
+BOOST_AUTO_TEST_CASE(channel_stream_full_drops_without_posting)
+{
+   using test_channel = channel_decl<struct full_stream_channel_tag, int>;
+
+   uint64_t dropped_at_publish = 0, dropped_with_subscriber = 0, dropped_at_end = 0;
+   std::vector<int> received;
+   run_app([&]() {
+      auto& chan = app().get_channel<test_channel>();
+      auto  sub  = std::make_shared<test_channel::channel_type::stream>(
+         chan.subscribe_stream(priority::high, 2, stream_overflow::drop_newest));
+      chan.publish(priority::medium, 1);
+      chan.publish(priority::medium, 2);
+
+      app().executor().post(priority::low, [&, sub]() {
+         // the buffer is full: counted as dropped on publish, not once a posted dispatch runs
+         auto& chan = app().get_channel<test_channel>();
+         for (int i = 3; i < 6; ++i)
+            chan.publish(priority::medium, i);
+         dropped_at_publish = sub->dropped();
+
+         // another kind of subscriber still gets every message posted
+         {
+            auto other = chan.subscribe([](const int&) {});
+            chan.publish(priority::medium, 6);
+            dropped_with_subscriber = sub->dropped();
+         }
+
+         while (auto msg = sub->try_next())
+            received.push_back(*msg);
+         chan.publish(priority::medium, 7);
+         app().executor().post(priority::lowest, [&, sub]() {
+            while (auto msg = sub->try_next())
+               received.push_back(*msg);
+            dropped_at_end = sub->dropped();
+            app().quit();
+         });
+      });
+   });
+
+   BOOST_CHECK_EQUAL(dropped_at_publish, 3u);
+   BOOST_CHECK_EQUAL(dropped_with_subscriber, 3u);
+   // 6 was posted, and dispatched once the buffer had been drained
+   BOOST_CHECK_EQUAL(dropped_at_end, 3u);
+   BOOST_CHECK(received == std::vector<int>({1, 2, 6, 7}));
+}
+
+// -----------------------------------------------------------------------------
+// Async synchronization primitives wake waiters on the main loop, highest
+// priority first, without blocking any thread.
+// -----------------------------------------------------------------------------
+BOOST_AUTO_TEST_CASE(async_mutex_wakes_by_priority)
+{
+   std::vector<int> order;
+   run_app([&]() {
+      auto m = std::make_shared<async_mutex<>>(app().executor());
+      BOOST_REQUIRE(m->try_lock());
+      for (int p : {priority::low, priority::high, priority::medium})
+         m->async_lock(p, [&, m]() {
+            order.push_back(priority::inherit());
+            m->unlock();
+            if (order.size() == 3)
+               app().quit();
+         });
+      BOOST_CHECK(!m->try_lock());
+      m->unlock();
+   });
+   BOOST_CHECK(order == std::vector<int>({priority::high, priority::medium, priority::low}));
+}
+
+BOOST_AUTO_TEST_CASE(async_semaphore_event_condition)
+{
+   std::vector<std::string> log;
+   bool ready = false;
+   std::thread worker;
+   run_app([&]() {
+      auto sem   = std::make_shared<async_semaphore<>>(app().executor(), 1);
+      auto ev    = std::make_shared<async_event<>>(app().executor());
+      auto m     = std::make_shared<async_mutex<>>(app().executor());
+      auto cv    = std::make_shared<async_condition<>>();
+
+      sem->async_acquire(priority::high, [&]() { log.push_back("acquire1"); });
+      sem->async_acquire(priority::high, [&, sem]() { log.push_back("acquire2"); });
+      ev->async_wait(priority::medium, [&, sem]() {
+         log.push_back("event");
+         sem->release();
+      });
+
+      m->async_lock(priority::high, [&, m, cv, ev]() {
+         cv->async_wait(*m, priority::high, [&, m, ev]() {
+            log.push_back(ready ? "notified" : "spurious");
+            m->unlock();
+            ev->async_wait(priority::lowest, []() { app().quit(); });
+         });
+         // notify from another thread; no thread blocks waiting for the main loop
+         worker = std::thread([&, m, cv, ev]() {
+            ev->set();
+            m->async_lock(priority::high, boost::asio::use_future).get();
+            ready = true;
+            m->unlock();
+            cv->notify_one();
+         });
+      });
+   });
+   worker.join();
+
+   // the worker's set() and notify_one() race with each other, not with the order of each primitive's waiters
+   auto pos = [&](const char* s) { return std::find(log.begin(), log.end(), s) - log.begin(); };
+   BOOST_REQUIRE_EQUAL(log.size(), 4u);
+   BOOST_CHECK_EQUAL(log[0], "acquire1");
+   BOOST_CHECK_LT(pos("event"), pos("acquire2"));
+   BOOST_CHECK_LT(pos("notified"), 4);
+}
+
+// -----------------------------------------------------------------------------
+// plugin_startup() / plugin_shutdown() returning a sender: startups overlap on
+// the main loop, dependents wait for their dependencies, shutdown is drained.
+// -----------------------------------------------------------------------------
+static auto work_on_thread(std::chrono::milliseconds d, std::atomic<bool>& flag) {
+   return execution::from_callback([d, &flag](auto done) {
+      std::thread([d, &flag, done]() {
+         std::this_thread::sleep_for(d);
+         flag = true;
+         done();
+      }).detach();
+   });
+}
+
+// async startups in flight, and the most seen at the same moment
+static std::atomic<int> startups_in_flight{0};
+static std::atomic<int> max_startups_in_flight{0};
+
+template <typename Impl>
+class async_plugin : public appbase::plugin<Impl> {
+public:
+   void set_program_options(boost::program_options::options_description&, boost::program_options::options_description&) override {}
+   void plugin_initialize(const boost::program_options::variables_map&) {}
+
+   auto plugin_startup() {
+      const int n = ++startups_in_flight;
+      for (int m = max_startups_in_flight; n > m && !max_startups_in_flight.compare_exchange_weak(m, n);)
+         ;
+      return execution::then(work_on_thread(std::chrono::milliseconds(100), started), []() { --startups_in_flight; });
+   }
+   auto plugin_shutdown() {
+      shutdown_before_started = !started;
+      return work_on_thread(std::chrono::milliseconds(20), stopped);
+   }
+
+   std::atomic<bool> started{false};
+   std::atomic<bool> stopped{false};
+   bool shutdown_before_started = false;
+};
+
+class async_pluginA : public async_plugin<async_pluginA> {
+public:
+   APPBASE_PLUGIN_REQUIRES();
+};
+
+class async_pluginB : public async_plugin<async_pluginB> {
+public:
+   APPBASE_PLUGIN_REQUIRES();
+};
+
+class async_failing_plugin : public appbase::plugin<async_failing_plugin> {
+public:
+   APPBASE_PLUGIN_REQUIRES();
+   void set_program_options(boost::program_options::options_description&, boost::program_options::options_description&) override {}
+   void plugin_initialize(const boost::program_options::variables_map&) {}
+   auto plugin_startup() {
+      return execution::then(work_on_thread(std::chrono::milliseconds(10), started),
+                             []() { throw std::runtime_error("startup failed"); });
+   }
+   void plugin_shutdown() {}
+
+   std::atomic<bool> started{false};
+};
+
+class async_dependent_plugin : public appbase::plugin<async_dependent_plugin> {
+public:
+   APPBASE_PLUGIN_REQUIRES((async_pluginA));
+   void set_program_options(boost::program_options::options_description&, boost::program_options::options_description&) override {}
+   void plugin_initialize(const boost::program_options::variables_map&) {}
+   void plugin_startup() { dependency_started = app().get_plugin<async_pluginA>().started; }
+   void plugin_shutdown() {}
+
+   bool dependency_started = false;
+};
+
+BOOST_AUTO_TEST_CASE(async_plugin_lifecycle)
+{
+   appbase::application::register_plugin<async_dependent_plugin>();
+   appbase::application::register_plugin<async_pluginB>();
+
+   bool a_stopped = false, b_stopped = false;
+   {
+      appbase::scoped_app sapp;
+      auto& app = *sapp.operator->();
+      const char* argv[] = { boost::unit_test::framework::current_test_case().p_name->c_str() };
+      BOOST_REQUIRE((app.initialize<async_pluginB, async_dependent_plugin>(1, const_cast<char**>(argv))));
+
+      max_startups_in_flight = 0;
+      app.startup();
+
+      auto& a = app.get_plugin<async_pluginA>();
+      auto& b = app.get_plugin<async_pluginB>();
+      BOOST_CHECK(a.started);
+      BOOST_CHECK(b.started);
+      BOOST_CHECK(app.get_plugin<async_dependent_plugin>().dependency_started);
+      // pluginA's and pluginB's startups overlap; async_dependent_plugin, started last, waits for pluginA
+      BOOST_CHECK_EQUAL(max_startups_in_flight.load(), 2);
+      BOOST_CHECK_EQUAL(startups_in_flight.load(), 0);
+
+      app.executor().post(priority::lowest, []() { appbase::app().quit(); });
+      app.exec();
+      a_stopped = a.stopped;
+      b_stopped = b.stopped;
+   }
+   BOOST_CHECK(a_stopped);
+   BOOST_CHECK(b_stopped);
+}
+
+BOOST_AUTO_TEST_CASE(async_plugin_startup_failure)
+{
+   appbase::application::register_plugin<async_pluginB>();
+   appbase::application::register_plugin<async_failing_plugin>();
+
+   appbase::scoped_app sapp;
+   auto& app = *sapp.operator->();
+   const char* argv[] = { boost::unit_test::framework::current_test_case().p_name->c_str() };
+   BOOST_REQUIRE((app.initialize<async_pluginB, async_failing_plugin>(1, const_cast<char**>(argv))));
+
+   // pluginB's startup is still running when async_failing_plugin's fails: it is shut down once it has completed
+   BOOST_CHECK_THROW(app.startup(), std::runtime_error);
+   auto& b = app.get_plugin<async_pluginB>();
+   BOOST_CHECK(b.started);
+   BOOST_CHECK(b.stopped);
+   BOOST_CHECK(!b.shutdown_before_started);
+   BOOST_CHECK_EQUAL(startups_in_flight.load(), 0);
+}
+
+// -----------------------------------------------------------------------------
+// Handler storage and channel stream buffers come from the given memory resources
+// -----------------------------------------------------------------------------
+BOOST_AUTO_TEST_CASE(memory_resources)
+{
+   using test_channel = channel_decl<struct resource_channel_tag, int>;
+
+   counting_resource handlers;
+   counting_resource streams;
+   size_t handler_bytes = 0, stream_bytes = 0;
+   std::string received;
+   {
+      appbase::scoped_app app;
+      const char* argv[] = { boost::unit_test::framework::current_test_case().p_name->c_str() };
+      BOOST_REQUIRE(app->initialize(sizeof(argv) / sizeof(char*), const_cast<char**>(argv)));
+      app->startup();
+
+      app->executor().set_memory_resource(&handlers);
+      app->get_channel<test_channel>().set_memory_resource(&streams);
+
+      auto sub = std::make_shared<test_channel::channel_type::stream>(
+         app->get_channel<test_channel>().subscribe_stream(priority::high, 16, stream_overflow::drop_oldest));
+      stream_bytes = streams.bytes_in_use();
+
+      // the asio operation carrying a post is allocated from the resource by the posting thread
+      const uint64_t before_post = handlers.allocations();
+      std::thread([&]() { app->executor().post(priority::low, []() {}); }).join();
+      BOOST_CHECK_GT(handlers.allocations(), before_post);
+
+      std::array<char, 1024> large{};   // too large to pool, allocated from the resource itself
+      app->executor().post(priority::high, [&, large]() { received += large[0] ? "?" : "large "; });
+      app->get_channel<test_channel>().publish(priority::medium, 7);
+      sub->async_next([&, sub](std::optional<int> msg) {
+         received += "message " + std::to_string(*msg);
+         handler_bytes = handlers.bytes_in_use();
+         app->quit();
+      });
+      app->exec();
+   }
+
+   BOOST_CHECK_EQUAL(received, "large message 7");
+   BOOST_CHECK_GE(handlers.allocations(), 2u);            // a slab and the large handler
+   BOOST_CHECK_GE(handlers.peak_bytes(), 64u * 1024 + 1024);
+   BOOST_CHECK_GT(handler_bytes, 0u);
+   BOOST_CHECK_GE(stream_bytes, 16 * sizeof(std::optional<int>));
+   BOOST_CHECK_EQUAL(handlers.bytes_in_use(), 0u);
+   BOOST_CHECK_EQUAL(streams.bytes_in_use(), 0u);
+}
+
+// -----------------------------------------------------------------------------
+// Payloads marked for deferred reclaim are destroyed on the reclaimer thread,
+// and by the caller once the bounded backlog is full.
+// -----------------------------------------------------------------------------
+namespace {
+   struct reclaim_tracker {
+      explicit reclaim_tracker(std::promise<std::thread::id>& p, std::function<void()> f = {})
+         : destroyed_on(p), in_destructor(std::move(f)) {}
+      ~reclaim_tracker() {
+         if (in_destructor)
+            in_destructor();
+         destroyed_on.set_value(std::this_thread::get_id());
+      }
+
+      std::promise<std::thread::id>& destroyed_on;
+      std::function<void()>          in_destructor;
+   };
+}
+
+BOOST_AUTO_TEST_CASE(deferred_reclaim)
+{
+   using test_channel = channel_decl<struct reclaim_channel_tag, std::shared_ptr<reclaim_tracker>>;
+
+   std::promise<std::thread::id> published, shared, captured;
+   std::thread::id main_thread;
+   run_app([&]() {
+      main_thread = std::this_thread::get_id();
+      auto& chan  = app().get_channel<test_channel>();
+      chan.set_deferred_reclaim(true);
+      auto sub = chan.subscribe([](const std::shared_ptr<reclaim_tracker>&) {});
+      chan.publish(priority::high, std::make_shared<reclaim_tracker>(published));
+
+      auto obj = make_reclaimed_shared<reclaim_tracker>(shared);
+      obj.reset();
+
+      app().executor().post(priority::high, reclaim_captures([t = std::make_shared<reclaim_tracker>(captured)]() {}));
+      app().executor().post(priority::lowest, [sub = std::move(sub)]() { app().quit(); });
+   });
+
+   for (auto* p : {&published, &shared, &captured}) {
+      const auto id = p->get_future().get();
+      BOOST_CHECK(id != main_thread);
+   }
+   auto st = reclaimer::instance().get_stats();
+   BOOST_CHECK_EQUAL(st.deferred, 3u);
+   BOOST_CHECK_EQUAL(st.reclaimed, 3u);
+   BOOST_CHECK_EQUAL(st.inline_destroy, 0u);
+   BOOST_CHECK_EQUAL(st.backlog, 0u);
+
+   // with a backlog of 1, an object retired while another waits is destroyed by the caller
+   {
+      appbase::scoped_app app;
+      const char* argv[] = { boost::unit_test::framework::current_test_case().p_name->c_str(), "--reclaim-backlog", "1" };
+      BOOST_REQUIRE(app->initialize(sizeof(argv) / sizeof(char*), const_cast<char**>(argv)));
+
+      std::promise<void> blocking, release;
+      std::promise<std::thread::id> blocker, waiting, overflow;
+      auto release_future = release.get_future().share();
+      reclaim_later(std::make_unique<reclaim_tracker>(blocker, [&]() {
+         blocking.set_value();
+         release_future.wait();
+      }));
+      blocking.get_future().wait();  // taken by the reclaimer thread, the backlog is empty
+      reclaim_later(std::make_unique<reclaim_tracker>(waiting));
+      reclaim_later(std::make_unique<reclaim_tracker>(overflow));
+      BOOST_CHECK(overflow.get_future().get() == std::this_thread::get_id());
+      release.set_value();
+      reclaimer::instance().flush();
+      BOOST_CHECK(waiting.get_future().get() != std::this_thread::get_id());
+
+      st = reclaimer::instance().get_stats();
+      BOOST_CHECK_EQUAL(st.deferred, 2u);
+      BOOST_CHECK_EQUAL(st.reclaimed, 2u);
+      BOOST_CHECK_EQUAL(st.inline_destroy, 1u);
+      BOOST_CHECK_EQUAL(st.peak_backlog, 2u);
+   }
+}
+
+// -----------------------------------------------------------------------------
+// Objects retired to a qsbr domain are destroyed only once every online
+// participant has passed a quiescent state; the main loop and thread pools of
+// the executor's domain announce theirs between handlers.
+// -----------------------------------------------------------------------------
+namespace {
+   struct rcu_value {
+      explicit rcu_value(int v, std::atomic<int>* destroyed = nullptr) : a(v), b(v), destroyed(destroyed) {}
+      rcu_value(const rcu_value& o) : a(o.a), b(o.b), destroyed(o.destroyed) {}
+      ~rcu_value() {
+         a = -1;
+         if (destroyed)
+            ++*destroyed;
+      }
+      int a, b;
+      std::atomic<int>* destroyed;
+   };
+}
+
+BOOST_AUTO_TEST_CASE(qsbr_grace_periods)
+{
+   std::atomic<int> destroyed = 0;
+   {
+      qsbr domain;
+      auto reader = std::make_unique<qsbr::participant>(domain);
+      qsbr::participant idle(domain);
+      rcu_ptr<rcu_value> ptr{domain, std::make_unique<rcu_value>(1, &destroyed)};
+
+      const rcu_value* seen = ptr.load();
+      ptr.update([](rcu_value& v) { v.a = v.b = 2; });
+      BOOST_CHECK_EQUAL(domain.pending(), 1u);
+      BOOST_CHECK_EQUAL(seen->a, 1);          // neither participant has passed a quiescent state
+      reader->quiescent();
+      BOOST_CHECK_EQUAL(destroyed, 0);
+      idle.offline();                          // offline participants do not hold grace periods back
+      BOOST_CHECK_EQUAL(destroyed, 1);
+      BOOST_CHECK_EQUAL(ptr.load()->a, 2);
+
+      idle.online();
+      ptr.store(std::make_unique<rcu_value>(3, &destroyed));
+      reader->quiescent();
+      BOOST_CHECK_EQUAL(destroyed, 1);
+      reader.reset();                          // unregistered
+      idle.quiescent();
+      BOOST_CHECK_EQUAL(destroyed, 2);
+      BOOST_CHECK_EQUAL(domain.pending(), 0u);
+   }
+   BOOST_CHECK_EQUAL(destroyed, 3);           // the last value, by the rcu_ptr
+
+   // readers on a thread pool, updates from the main loop
+   struct shared_state {
+      shared_state(std::atomic<int>& destroyed)
+         : ptr(app().executor().get_qsbr(), std::make_unique<rcu_value>(0, &destroyed))
+         , pool(app().executor().get_safepoint(), &app().executor().get_qsbr()) {}
+
+      void read() {
+         const rcu_value* v = ptr.load();
+         if (v->a != v->b)
+            ++torn;
+         if (!stop)
+            boost::asio::post(pool.get_executor(), [this]() { read(); });
+      }
+
+      rcu_ptr<rcu_value> ptr;
+      thread_pool        pool;
+      std::atomic<bool>  stop = false;
+      std::atomic<int>   torn = 0;
+   };
+
+   destroyed = 0;
+   int torn = 0;
+   const int updates = 2000;
+   std::unique_ptr<shared_state> st;
+   std::function<void(int)> update = [&](int i) {
+      st->ptr.update([i](rcu_value& v) { v.a = v.b = i; });
+      if (i < updates) {
+         app().executor().post(priority::medium, [&, i]() { update(i + 1); });
+         return;
+      }
+      st->stop = true;
+      st->pool.stop();
+      BOOST_CHECK_EQUAL(app().executor().get_qsbr().participants(), 1u);   // the main loop
+      torn = st->torn;
+      st.reset();
+      app().quit();
+   };
+   run_app([&]() {
+      st = std::make_unique<shared_state>(destroyed);
+      st->pool.start(2, [](std::exception_ptr) {});
+      boost::asio::post(st->pool.get_executor(), [&]() { st->read(); });
+      boost::asio::post(st->pool.get_executor(), [&]() { st->read(); });
+      update(1);
+   });
+   BOOST_CHECK_EQUAL(torn, 0);
+   BOOST_CHECK_EQUAL(destroyed, updates + 1);
+}
@@ -0,0 +1,95 @@
+#include <appbase/application.hpp>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+// a test executable of its own, linked with appbase_heap_accounting which replaces the global operator new/delete
+#define BOOST_TEST_MODULE Heap Accounting Tests
+#include <boost/test/included/unit_test.hpp>
+
+namespace bu = boost::unit_test;
+
+using boost::program_options::options_description;
+using boost::program_options::variables_map;
+
+// -----------------------------------------------------------------------------
+// Check that allocations are attributed to the plugin whose code makes them:
+// lifecycle calls, channel subscribers and method providers
+// -----------------------------------------------------------------------------
+using heap_events_channel = appbase::channel_decl<struct heap_events_tag, int>;
+using heap_fill_method    = appbase::method_decl<struct heap_fill_tag, size_t(size_t)>;
+
+class heap_plugin : public appbase::plugin<heap_plugin>
+{
+public:
+   APPBASE_PLUGIN_REQUIRES();
+
+   virtual void set_program_options( options_description& cli, options_description& cfg ) override {}
+   void plugin_initialize( const variables_map& options ) {
+      initialized.resize(1 << 20);
+      fill = appbase::app().get_method<heap_fill_method>().register_provider(
+         [this](size_t bytes) { return buffers.emplace_back(bytes).size(); });
+   }
+   void plugin_startup() {
+      events = appbase::app().get_channel<heap_events_channel>().subscribe(
+         [this](const int& n) { buffers.emplace_back(size_t(n)); });
+   }
+   void plugin_shutdown() {
+      events.unsubscribe();
+      fill.unregister();
+   }
+
+   std::vector<char>                       initialized;
+   std::vector<std::vector<char>>          buffers;
+   heap_events_channel::channel_type::handle events;
+   heap_fill_method::method_type::handle     fill;
+};
+
+BOOST_AUTO_TEST_CASE(heap_accounting_by_plugin)
+{
+   BOOST_REQUIRE(appbase::heap_accounting::interposed());
+   appbase::application::register_plugin<heap_plugin>();
+   appbase::scoped_app app;
+
+   const char* argv[] = { bu::framework::current_test_case().p_name->c_str(), "--heap-accounting" };
+   BOOST_REQUIRE(app->initialize<heap_plugin>(sizeof(argv) / sizeof(char*), const_cast<char**>(argv)));
+   BOOST_REQUIRE(appbase::heap_accounting::enabled());
+   app->startup();
+
+   auto& plugin = app->get_plugin<heap_plugin>();
+   plugin.buffers.reserve(4); // not attributed to the plugin
+   const auto usage_of = [&](const std::string& name) {
+      for (const auto& [n, u] : app->heap_usage())
+         if (n == name)
+            return u;
+      return appbase::heap_accounting::usage{};
+   };
+   const auto before = usage_of("heap_plugin");
+   BOOST_CHECK_GE(before.live_bytes, 1 << 20);
+
+   std::atomic<int64_t> worker_freed{0};
+   app->executor().post(appbase::priority::high, [&]() {
+      app->get_channel<heap_events_channel>().publish(appbase::priority::high, 256 << 10);
+      app->get_method<heap_fill_method>()(size_t(128) << 10);
+      app->executor().post(appbase::priority::low, [&]() {
+         const auto after = usage_of("heap_plugin");
+         // the published int is copied by the main loop, the buffers by the plugin's subscriber and provider
+         BOOST_CHECK_GE(after.live_bytes - before.live_bytes, 384 << 10);
+         BOOST_CHECK_GE(after.allocations - before.allocations, 2u);
+
+         // freed on another thread, still counted against the plugin
+         auto released = std::move(plugin.buffers);
+         std::thread([&]() {
+            released.clear();
+            released.shrink_to_fit();
+         }).join();
+         worker_freed = after.live_bytes - usage_of("heap_plugin").live_bytes;
+         app->quit();
+      });
+   });
+   app->exec();
+
+   BOOST_CHECK_GE(worker_freed.load(), 384 << 10);
+   appbase::heap_accounting::enable(false);
+}
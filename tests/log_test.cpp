@@ -0,0 +1,163 @@
+#include <appbase/application.hpp>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+#include <boost/test/unit_test.hpp>
+
+using namespace appbase;
+
+namespace {
+std::string read_file(const std::filesystem::path& p) {
+   std::ifstream f(p);
+   std::stringstream ss;
+   ss << f.rdbuf();
+   return ss.str();
+}
+
+struct temp_dir {
+   std::filesystem::path path = std::filesystem::temp_directory_path() / ("appbase_log_test_" + std::to_string(::getpid()));
+   temp_dir() { std::filesystem::remove_all(path); }
+   ~temp_dir() { std::filesystem::remove_all(path); }
+};
+} // namespace
+
+// -----------------------------------------------------------------------------
+// Records are formatted on the logging thread, filtered by level and rotated
+// -----------------------------------------------------------------------------
+BOOST_AUTO_TEST_CASE(log_to_rotated_file)
+{
+   temp_dir dir;
+   log_config config;
+   config.file         = dir.path / "test.log";
+   config.rotate_size  = 4096;
+   config.rotate_count = 2;
+   config.level        = log_level::info;
+   config.levels["log_test_verbose"] = log_level::debug;
+   log_backend::instance().start(config);
+
+   auto& quiet   = get_logger("log_test_quiet");
+   auto& verbose = get_logger("log_test_verbose");
+   std::string_view sv = "view";
+   APPBASE_ILOG(quiet, "value {} and {} of {}", 42, std::string("string"), sv);
+   char buf[] = "copied";
+   const std::string long_string(100, 'x');
+   APPBASE_ILOG(quiet, "{} strings {} {}", buf, long_string, 7);
+   std::strcpy(buf, "change");
+   APPBASE_DLOG(quiet, "filtered out");
+   APPBASE_DLOG(verbose, "debug kept");
+
+   std::thread([&]() { APPBASE_WLOG(quiet, "from another thread"); }).join();
+   log_backend::instance().flush();
+
+   auto text = read_file(config.file);
+   BOOST_CHECK(text.find("info") != std::string::npos);
+   BOOST_CHECK(text.find("log_test_quiet log_test.cpp:") != std::string::npos);
+   BOOST_CHECK(text.find("] value 42 and string of view\n") != std::string::npos);
+   BOOST_CHECK(text.find("] copied strings " + long_string + " 7\n") != std::string::npos);
+   BOOST_CHECK(text.find("filtered out") == std::string::npos);
+   BOOST_CHECK(text.find("debug kept") != std::string::npos);
+   BOOST_CHECK(text.find("from another thread") != std::string::npos);
+
+   // runtime level change
+   quiet.set_level(log_level::error);
+   APPBASE_WLOG(quiet, "now filtered");
+   for (int i = 0; i < 200; ++i)
+      APPBASE_ELOG(quiet, "filler record number {} to force rotation", i);
+   log_backend::instance().stop();
+
+   BOOST_CHECK(std::filesystem::exists(config.file.string() + ".1"));
+   BOOST_CHECK(std::filesystem::exists(config.file.string() + ".2"));
+   BOOST_CHECK(!std::filesystem::exists(config.file.string() + ".3"));
+   BOOST_CHECK(std::filesystem::file_size(config.file) <= config.rotate_size);
+   BOOST_CHECK(read_file(config.file).find("filler record number 199") != std::string::npos);
+   BOOST_CHECK(read_file(config.file).find("now filtered") == std::string::npos);
+   BOOST_CHECK_EQUAL(log_backend::instance().dropped(), 0u);
+}
+
+// -----------------------------------------------------------------------------
+// A full buffer rejects records instead of blocking, and wraps once consumed
+// -----------------------------------------------------------------------------
+BOOST_AUTO_TEST_CASE(log_buffer_full_and_wrap)
+{
+   detail::log_buffer buf(1024, 0);
+   const size_t size = 192;
+
+   size_t reserved = 0;
+   while (void* p = buf.try_reserve(size)) {
+      static_cast<detail::log_record*>(p)->size = size;
+      buf.commit();
+      ++reserved;
+   }
+   BOOST_CHECK_EQUAL(reserved, 1024 / size);
+
+   // free two records, the next one does not fit before the end of the buffer and wraps to the start
+   size_t consumed = 0;
+   buf.consume([&](const detail::log_record&, void*) { ++consumed; });
+   BOOST_CHECK_EQUAL(consumed, reserved);
+   for (int i = 0; i < 2 * int(reserved); ++i) {
+      void* p = buf.try_reserve(size);
+      BOOST_REQUIRE(p);
+      static_cast<detail::log_record*>(p)->size = size;
+      buf.commit();
+      consumed = 0;
+      buf.consume([&](const detail::log_record&, void*) { ++consumed; });
+      BOOST_CHECK_EQUAL(consumed, 1u);
+   }
+   BOOST_CHECK(buf.empty());
+}
+
+// -----------------------------------------------------------------------------
+// An idle logging thread waits without polling and is woken by the record
+// committed to a drained buffer
+// -----------------------------------------------------------------------------
+BOOST_AUTO_TEST_CASE(log_thread_woken_by_record)
+{
+   detail::log_buffer buf(1024, 0);
+   for (bool drained : {true, false}) {
+      static_cast<detail::log_record*>(buf.try_reserve(64))->size = 64;
+      BOOST_CHECK_EQUAL(buf.commit(), drained);
+   }
+
+   temp_dir dir;
+   log_config config;
+   config.file = dir.path / "idle.log";
+   log_backend::instance().start(config);
+   auto& log = get_logger("log_test_idle");
+   std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+   std::thread([&]() { APPBASE_ILOG(log, "after idle"); }).join();
+   bool written = false;
+   for (int i = 0; i < 500 && !written; ++i) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      written = read_file(config.file).find("after idle") != std::string::npos;
+   }
+   BOOST_CHECK(written);
+   log_backend::instance().stop();
+}
+
+// -----------------------------------------------------------------------------
+// The application starts logging from its options and names plugin loggers
+// -----------------------------------------------------------------------------
+BOOST_AUTO_TEST_CASE(log_application_options)
+{
+   temp_dir dir;
+   appbase::scoped_app app;
+   auto argv0 = boost::unit_test::framework::current_test_case().p_name->c_str();
+   std::string data_dir = dir.path.string();
+   const char* argv[] = { argv0, "--data-dir", data_dir.c_str(), "--log-file", "logs/app.log", "--log-level", "warn",
+                          "--log-level-for", "log_test_plugin=debug" };
+   BOOST_REQUIRE(app->initialize(sizeof(argv) / sizeof(char*), const_cast<char**>(argv)));
+   BOOST_CHECK(log_backend::instance().running());
+   BOOST_CHECK(get_logger("appbase").level() == log_level::warn);
+   BOOST_CHECK(get_logger("log_test_plugin").level() == log_level::debug);
+
+   APPBASE_ILOG(get_logger("appbase"), "appbase info filtered");
+   APPBASE_DLOG(get_logger("log_test_plugin"), "plugin debug kept");
+   log_backend::instance().flush();
+
+   auto text = read_file(dir.path / "logs/app.log");
+   BOOST_CHECK(text.find("appbase info filtered") == std::string::npos);
+   BOOST_CHECK(text.find("plugin debug kept") != std::string::npos);
+}